@@ -0,0 +1,233 @@
+#include "AnimationSampler.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define ANIMATION_SAMPLER_SSE
+#endif
+
+namespace {
+
+//tracks are interpolated in batches of this many, stored as structure-of-arrays:
+enum : uint32_t { BatchWidth = 64 };
+static_assert(BatchWidth % 4 == 0, "batch is a whole number of vectors");
+
+struct Batch {
+	alignas(16) float u[BatchWidth]; //interpolation amount in [0,1]
+	alignas(16) float a[4][BatchWidth]; //key before, by component
+	alignas(16) float b[4][BatchWidth]; //key after, by component
+	alignas(16) float result[4][BatchWidth];
+	uint32_t count = 0; //tracks in use (entries past count are padding)
+};
+
+} //end anonymous namespace
+
+//result = a + (b - a) * u, for x,y,z:
+static void lerp_batch(Batch &batch) {
+	for (uint32_t c = 0; c < 3; ++c) {
+#if defined(ANIMATION_SAMPLER_SSE)
+		for (uint32_t i = 0; i < batch.count; i += 4) {
+			__m128 a = _mm_load_ps(&batch.a[c][i]);
+			__m128 b = _mm_load_ps(&batch.b[c][i]);
+			__m128 u = _mm_load_ps(&batch.u[i]);
+			_mm_store_ps(&batch.result[c][i], _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), u)));
+		}
+#else
+		for (uint32_t i = 0; i < batch.count; ++i) {
+			batch.result[c][i] = batch.a[c][i] + (batch.b[c][i] - batch.a[c][i]) * batch.u[i];
+		}
+#endif
+	}
+}
+
+//result = normalize(a + (b' - a) * u), where b' is b or -b (whichever is nearer to a), for quaternions x,y,z,w:
+static void nlerp_batch(Batch &batch) {
+#if defined(ANIMATION_SAMPLER_SSE)
+	__m128 const zero = _mm_setzero_ps();
+	__m128 const one = _mm_set1_ps(1.0f);
+	__m128 const sign_bit = _mm_set1_ps(-0.0f);
+	for (uint32_t i = 0; i < batch.count; i += 4) {
+		__m128 a[4], b[4];
+		__m128 dot = zero;
+		for (uint32_t c = 0; c < 4; ++c) {
+			a[c] = _mm_load_ps(&batch.a[c][i]);
+			b[c] = _mm_load_ps(&batch.b[c][i]);
+			dot = _mm_add_ps(dot, _mm_mul_ps(a[c], b[c]));
+		}
+		__m128 flip = _mm_and_ps(_mm_cmplt_ps(dot, zero), sign_bit);
+		__m128 u = _mm_load_ps(&batch.u[i]);
+		__m128 r[4];
+		__m128 length2 = zero;
+		for (uint32_t c = 0; c < 4; ++c) {
+			r[c] = _mm_add_ps(a[c], _mm_mul_ps(_mm_sub_ps(_mm_xor_ps(b[c], flip), a[c]), u));
+			length2 = _mm_add_ps(length2, _mm_mul_ps(r[c], r[c]));
+		}
+		__m128 inv_length = _mm_div_ps(one, _mm_sqrt_ps(length2));
+		for (uint32_t c = 0; c < 4; ++c) {
+			_mm_store_ps(&batch.result[c][i], _mm_mul_ps(r[c], inv_length));
+		}
+	}
+#else
+	for (uint32_t i = 0; i < batch.count; ++i) {
+		float dot = 0.0f;
+		for (uint32_t c = 0; c < 4; ++c) dot += batch.a[c][i] * batch.b[c][i];
+		float sign = (dot < 0.0f ? -1.0f : 1.0f);
+		float r[4];
+		float length2 = 0.0f;
+		for (uint32_t c = 0; c < 4; ++c) {
+			r[c] = batch.a[c][i] + (sign * batch.b[c][i] - batch.a[c][i]) * batch.u[i];
+			length2 += r[c] * r[c];
+		}
+		float inv_length = 1.0f / std::sqrt(length2);
+		for (uint32_t c = 0; c < 4; ++c) batch.result[c][i] = r[c] * inv_length;
+	}
+#endif
+}
+
+//-------------------------
+
+AnimationSampler::AnimationSampler(Scene const &scene) {
+	build(scene);
+}
+
+void AnimationSampler::build(Scene const &scene) {
+	if (scene.key_values.size() != scene.key_times.size()) {
+		throw std::runtime_error("Scene has " + std::to_string(scene.key_times.size()) + " key times but " + std::to_string(scene.key_values.size()) + " key values.");
+	}
+	times = scene.key_times;
+	values = scene.key_values;
+
+	//positions and scales first, then rotations:
+	std::vector< Scene::Track const * > sorted;
+	sorted.reserve(scene.tracks.size());
+	for (auto const &track : scene.tracks) sorted.emplace_back(&track);
+	std::stable_partition(sorted.begin(), sorted.end(), [](Scene::Track const *track) {
+		return track->channel != Scene::Track::Rotation;
+	});
+
+	transforms.clear();
+	channels.clear();
+	key_begins.clear();
+	key_ends.clear();
+	duration = 0.0f;
+	rotations_begin = 0;
+	for (Scene::Track const *track : sorted) {
+		assert(track->transform);
+		if (!(track->key_begin < track->key_end && track->key_end <= times.size())) {
+			throw std::runtime_error("Track of '" + track->transform->name + "' has invalid key range [" + std::to_string(track->key_begin) + ", " + std::to_string(track->key_end) + ").");
+		}
+		if (track->channel != Scene::Track::Rotation) rotations_begin += 1;
+		transforms.emplace_back(track->transform);
+		channels.emplace_back(track->channel);
+		key_begins.emplace_back(track->key_begin);
+		key_ends.emplace_back(track->key_end);
+		duration = std::max(duration, times[track->key_end - 1]);
+	}
+	cursors = key_begins;
+	hierarchy_indices.assign(transforms.size(), -1U);
+}
+
+template< typename Write >
+void AnimationSampler::sample_tracks(float time, Write const &write) {
+	if (loop && duration > 0.0f) time -= std::floor(time / duration) * duration;
+
+	Batch batch;
+	auto run = [&](uint32_t begin, uint32_t end, bool rotations) {
+		for (uint32_t first = begin; first < end; first += BatchWidth) {
+			batch.count = std::min(uint32_t(BatchWidth), end - first);
+
+			//find each track's keys and gather them into the batch:
+			for (uint32_t i = 0; i < batch.count; ++i) {
+				uint32_t t = first + i;
+				uint32_t key_begin = key_begins[t];
+				uint32_t key_end = key_ends[t];
+				uint32_t &k = cursors[t];
+				if (time < times[k] || (k + 2 < key_end && times[k + 2] <= time)) {
+					//time jumped -- search for the last key at or before it:
+					uint32_t after = uint32_t(std::upper_bound(times.data() + key_begin, times.data() + key_end, time) - times.data());
+					k = (after > key_begin ? after - 1 : key_begin);
+				} else if (k + 1 < key_end && times[k + 1] <= time) {
+					//time moved on to the next key (the usual case when playing forward):
+					k += 1;
+				}
+				uint32_t next = std::min(k + 1, key_end - 1);
+				float span = times[next] - times[k];
+				float u = (span > 0.0f ? (time - times[k]) / span : 0.0f);
+				batch.u[i] = std::min(std::max(u, 0.0f), 1.0f);
+				for (uint32_t c = 0; c < 4; ++c) {
+					batch.a[c][i] = values[k][c];
+					batch.b[c][i] = values[next][c];
+				}
+			}
+			//pad to a whole number of vectors (with identity rotations, so nlerp stays finite):
+			while (batch.count % 4 != 0) {
+				batch.u[batch.count] = 0.0f;
+				for (uint32_t c = 0; c < 4; ++c) {
+					batch.a[c][batch.count] = batch.b[c][batch.count] = (c == 3 ? 1.0f : 0.0f);
+				}
+				batch.count += 1;
+			}
+
+			if (rotations) nlerp_batch(batch);
+			else lerp_batch(batch);
+
+			for (uint32_t i = 0; first + i < end && i < BatchWidth; ++i) {
+				write(first + i, glm::vec4(batch.result[0][i], batch.result[1][i], batch.result[2][i], batch.result[3][i]));
+			}
+		}
+	};
+	run(0, rotations_begin, false);
+	run(rotations_begin, size(), true);
+}
+
+void AnimationSampler::sample(float time) {
+	sample_tracks(time, [this](uint32_t t, glm::vec4 const &value) {
+		Scene::Transform *transform = transforms[t];
+		if (channels[t] == Scene::Track::Position) {
+			glm::vec3 position = glm::vec3(value);
+			if (position != transform->position) transform->set_position(position);
+		} else if (channels[t] == Scene::Track::Rotation) {
+			glm::quat rotation = glm::quat(value.w, value.x, value.y, value.z); //n.b. wxyz init order
+			if (rotation != transform->rotation) transform->set_rotation(rotation);
+		} else {
+			glm::vec3 scale = glm::vec3(value);
+			if (scale != transform->scale) transform->set_scale(scale);
+		}
+	});
+}
+
+void AnimationSampler::bind(TransformHierarchy const &hierarchy) {
+	std::unordered_map< Scene::Transform const *, uint32_t > index;
+	index.reserve(hierarchy.size());
+	for (uint32_t i = 0; i < hierarchy.size(); ++i) {
+		index.emplace(hierarchy.transforms[i], i);
+	}
+	hierarchy_indices.resize(transforms.size());
+	for (uint32_t t = 0; t < size(); ++t) {
+		auto f = index.find(transforms[t]);
+		hierarchy_indices[t] = (f != index.end() ? f->second : -1U);
+	}
+}
+
+void AnimationSampler::sample(float time, TransformHierarchy *hierarchy_) {
+	assert(hierarchy_);
+	TransformHierarchy &hierarchy = *hierarchy_;
+	sample_tracks(time, [this, &hierarchy](uint32_t t, glm::vec4 const &value) {
+		uint32_t i = hierarchy_indices[t];
+		if (i == -1U) return;
+		assert(i < hierarchy.size());
+		if (channels[t] == Scene::Track::Position) {
+			hierarchy.positions[i] = glm::vec3(value);
+		} else if (channels[t] == Scene::Track::Rotation) {
+			hierarchy.rotations[i] = glm::quat(value.w, value.x, value.y, value.z); //n.b. wxyz init order
+		} else {
+			hierarchy.scales[i] = glm::vec3(value);
+		}
+	});
+}
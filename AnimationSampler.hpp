@@ -0,0 +1,72 @@
+#pragma once
+
+/*
+ * An AnimationSampler plays back a scene's keyframe tracks (see Scene::Track).
+ *
+ * Tracks are sampled many at a time: each track's current pair of keys is found
+ *  (starting from where the previous sample left off, so playing forward is cheap),
+ *  the keys are gathered into structure-of-arrays batches, and positions/scales are
+ *  linearly interpolated and rotations normalized-linearly interpolated ("nlerp",
+ *  along the shorter arc) several tracks at a time (SSE when compiled for it, scalar otherwise).
+ *
+ * Results are written either straight into the tracks' Scene::Transforms, or into
+ *  the flat arrays of a TransformHierarchy (which then computes world matrices).
+ *
+ * Usage:
+ *  AnimationSampler animation(scene);
+ *  //each frame:
+ *  time += elapsed;
+ *  animation.sample(time); //(loops every animation.duration seconds)
+ *
+ * NOTE: call build() again after changing the scene's tracks.
+ *
+ */
+
+#include "Scene.hpp"
+#include "TransformHierarchy.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+
+struct AnimationSampler {
+	AnimationSampler() = default;
+	AnimationSampler(Scene const &scene);
+
+	//copy the scene's tracks and keys into the sampler's arrays:
+	void build(Scene const &scene);
+
+	//set the tracks' transforms to their values at a given time:
+	// (only values that change are written, and those transforms are marked dirty)
+	void sample(float time);
+
+	//look up the tracks' transforms in a hierarchy (call again after hierarchy.build()):
+	void bind(TransformHierarchy const &hierarchy);
+	//set values in the bound hierarchy's positions/rotations/scales arrays instead:
+	// (tracks of transforms that aren't in the hierarchy are skipped)
+	void sample(float time, TransformHierarchy *hierarchy);
+
+	float duration = 0.0f; //time of the latest key in any track
+	bool loop = true; //if set, times are wrapped to [0,duration); otherwise, tracks hold their last values
+
+	uint32_t size() const { return uint32_t(transforms.size()); }
+
+	//--- internals ---
+
+	//tracks are sorted by channel, so that a batch only holds one kind of channel:
+	// [0, rotations_begin) are positions and scales, [rotations_begin, size()) are rotations
+	std::vector< Scene::Transform * > transforms;
+	std::vector< Scene::Track::Channel > channels;
+	std::vector< uint32_t > key_begins, key_ends;
+	std::vector< uint32_t > cursors; //per track, index of the key that the last sample came after (or at)
+	std::vector< uint32_t > hierarchy_indices; //per track, index in the bound hierarchy (-1U if not in it)
+	uint32_t rotations_begin = 0;
+
+	std::vector< float > times;
+	std::vector< glm::vec4 > values;
+
+	//interpolate every track at time, passing (track index, value) to 'write':
+	template< typename Write >
+	void sample_tracks(float time, Write const &write);
+};
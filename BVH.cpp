@@ -0,0 +1,389 @@
+#include "BVH.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+//spread the low 10 bits of x out to every third bit:
+static uint32_t spread_bits(uint32_t x) {
+	x &= 0x3ff;
+	x = (x | (x << 16)) & 0x030000ff;
+	x = (x | (x << 8)) & 0x0300f00f;
+	x = (x | (x << 4)) & 0x030c30c3;
+	x = (x | (x << 2)) & 0x09249249;
+	return x;
+}
+
+void BVH::build(std::vector< Item > const &items_) {
+	clear();
+	if (items_.empty()) return;
+
+	//sort items along a Morton (z-order) curve through their centers, so that nearby items end up nearby in the array:
+	// (this is much faster than partitioning items at every level, and makes comparable trees)
+	{
+		glm::vec3 center_min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 center_max = glm::vec3(-std::numeric_limits< float >::infinity());
+		for (auto const &item : items_) {
+			glm::vec3 center = 0.5f * (item.min + item.max);
+			center_min = glm::min(center_min, center);
+			center_max = glm::max(center_max, center);
+		}
+		//(same scale on every axis, so that codes follow actual distances)
+		glm::vec3 extent = center_max - center_min;
+		float scale = 1023.0f / std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-20f));
+
+		std::vector< uint64_t > order; //(morton code << 32) | item index
+		order.reserve(items_.size());
+		for (uint32_t i = 0; i < items_.size(); ++i) {
+			glm::uvec3 q = glm::uvec3((0.5f * (items_[i].min + items_[i].max) - center_min) * scale);
+			uint32_t code = (spread_bits(q.x) << 2) | (spread_bits(q.y) << 1) | spread_bits(q.z);
+			order.emplace_back((uint64_t(code) << 32) | i);
+		}
+		std::sort(order.begin(), order.end());
+
+		items.reserve(items_.size());
+		for (uint64_t o : order) {
+			items.emplace_back(items_[uint32_t(o)]);
+		}
+	}
+
+	//split the sorted items in half, recursively, until leaves are small enough:
+	//a tree with leaves of size > LeafSize/2 has at most 2 * (items / (LeafSize/2)) nodes:
+	nodes.reserve(4 * items.size() / LeafSize + 1);
+	nodes.emplace_back();
+	parents.reserve(nodes.capacity());
+	parents.emplace_back(-1U);
+	leaves.resize(items.size());
+
+	struct Todo {
+		uint32_t node;
+		uint32_t begin, end;
+	};
+	std::vector< Todo > todo;
+	todo.emplace_back(Todo{0, 0, uint32_t(items.size())});
+	while (!todo.empty()) {
+		Todo t = todo.back();
+		todo.pop_back();
+
+		if (t.end - t.begin <= LeafSize) {
+			nodes[t.node].first = t.begin;
+			nodes[t.node].count = t.end - t.begin;
+			std::fill(leaves.begin() + t.begin, leaves.begin() + t.end, t.node);
+			continue;
+		}
+
+		uint32_t mid = (t.begin + t.end) / 2;
+		uint32_t child = uint32_t(nodes.size());
+		nodes.emplace_back();
+		nodes.emplace_back();
+		parents.emplace_back(t.node);
+		parents.emplace_back(t.node);
+		nodes[t.node].first = child;
+		nodes[t.node].count = 0;
+		todo.emplace_back(Todo{child, t.begin, mid});
+		todo.emplace_back(Todo{child + 1, mid, t.end});
+	}
+
+	refit();
+}
+
+void BVH::clear() {
+	items.clear();
+	nodes.clear();
+	parents.clear();
+	leaves.clear();
+}
+
+void BVH::set_bounds(uint32_t item, glm::vec3 const &min, glm::vec3 const &max) {
+	assert(item < items.size());
+	items[item].min = min;
+	items[item].max = max;
+}
+
+//bounds of a node's items or children:
+static void fit_node(BVH const &bvh, BVH::Node const &node, glm::vec3 *min, glm::vec3 *max) {
+	if (node.count) {
+		*min = bvh.items[node.first].min;
+		*max = bvh.items[node.first].max;
+		for (uint32_t i = node.first + 1; i < node.first + node.count; ++i) {
+			*min = glm::min(*min, bvh.items[i].min);
+			*max = glm::max(*max, bvh.items[i].max);
+		}
+	} else {
+		*min = glm::min(bvh.nodes[node.first].min, bvh.nodes[node.first + 1].min);
+		*max = glm::max(bvh.nodes[node.first].max, bvh.nodes[node.first + 1].max);
+	}
+}
+
+void BVH::refit() {
+	//children come after their parents, so a reverse pass sees children first:
+	for (uint32_t n = uint32_t(nodes.size()) - 1; n < nodes.size(); --n) {
+		fit_node(*this, nodes[n], &nodes[n].min, &nodes[n].max);
+	}
+}
+
+void BVH::refit(std::vector< uint32_t > const &changed) {
+	for (uint32_t item : changed) {
+		assert(item < items.size());
+		//walk up from the item's leaf, stopping once a node's bounds come out the same (so its ancestors' will too):
+		for (uint32_t n = leaves[item]; n != -1U; n = parents[n]) {
+			glm::vec3 min, max;
+			fit_node(*this, nodes[n], &min, &max);
+			if (min == nodes[n].min && max == nodes[n].max) break;
+			nodes[n].min = min;
+			nodes[n].max = max;
+		}
+	}
+}
+
+void BVH::frustum(glm::mat4 const &world_to_clip, std::vector< uint32_t > *ids) const {
+	assert(ids);
+	if (nodes.empty()) return;
+
+	//clip planes as (normal, offset) -- a point p is inside plane i when dot(planes[i], vec4(p,1)) >= 0:
+	// (these are w+x, w-x, w+y, w-y, w+z, w-z in clip space)
+	glm::vec4 planes[6];
+	{
+		glm::mat4 m = glm::transpose(world_to_clip); //rows of world_to_clip
+		for (uint32_t i = 0; i < 3; ++i) {
+			planes[2*i+0] = m[3] + m[i];
+			planes[2*i+1] = m[3] - m[i];
+		}
+	}
+
+	//for each node, which planes it still needs to be tested against:
+	// (once a node is entirely inside a plane, so are all of its children)
+	struct Todo {
+		uint32_t node;
+		uint32_t planes;
+	};
+	std::vector< Todo > todo;
+	todo.emplace_back(Todo{0, (1 << 6) - 1});
+	while (!todo.empty()) {
+		Todo t = todo.back();
+		todo.pop_back();
+		Node const &node = nodes[t.node];
+
+		bool outside = false;
+		for (uint32_t i = 0; i < 6; ++i) {
+			if (!(t.planes & (1 << i))) continue;
+			glm::vec3 normal = glm::vec3(planes[i]);
+			//corner of box furthest along normal, and corner furthest against it:
+			glm::vec3 outermost = glm::vec3(normal.x > 0.0f ? node.max.x : node.min.x, normal.y > 0.0f ? node.max.y : node.min.y, normal.z > 0.0f ? node.max.z : node.min.z);
+			glm::vec3 innermost = glm::vec3(normal.x > 0.0f ? node.min.x : node.max.x, normal.y > 0.0f ? node.min.y : node.max.y, normal.z > 0.0f ? node.min.z : node.max.z);
+			if (glm::dot(normal, outermost) + planes[i].w < 0.0f) {
+				outside = true;
+				break;
+			}
+			if (glm::dot(normal, innermost) + planes[i].w >= 0.0f) {
+				t.planes &= ~(1 << i);
+			}
+		}
+		if (outside) continue;
+
+		if (t.planes == 0) {
+			//entirely inside: every item below this node is visible.
+			// (items below a node are contiguous, from its leftmost leaf to its rightmost leaf)
+			uint32_t left = t.node, right = t.node;
+			while (nodes[left].count == 0) left = nodes[left].first;
+			while (nodes[right].count == 0) right = nodes[right].first + 1;
+			for (uint32_t i = nodes[left].first; i < nodes[right].first + nodes[right].count; ++i) {
+				ids->emplace_back(items[i].id);
+			}
+		} else if (node.count) {
+			//partially inside leaf: test items individually
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				Item const &item = items[i];
+				bool item_outside = false;
+				for (uint32_t p = 0; p < 6; ++p) {
+					if (!(t.planes & (1 << p))) continue;
+					glm::vec3 normal = glm::vec3(planes[p]);
+					glm::vec3 outermost = glm::vec3(normal.x > 0.0f ? item.max.x : item.min.x, normal.y > 0.0f ? item.max.y : item.min.y, normal.z > 0.0f ? item.max.z : item.min.z);
+					if (glm::dot(normal, outermost) + planes[p].w < 0.0f) {
+						item_outside = true;
+						break;
+					}
+				}
+				if (!item_outside) ids->emplace_back(item.id);
+			}
+		} else {
+			todo.emplace_back(Todo{node.first, t.planes});
+			todo.emplace_back(Todo{node.first + 1, t.planes});
+		}
+	}
+}
+
+void BVH::overlap(glm::vec3 const &min, glm::vec3 const &max, std::vector< uint32_t > *ids) const {
+	assert(ids);
+	if (nodes.empty()) return;
+
+	auto overlaps = [&min, &max](glm::vec3 const &a, glm::vec3 const &b) {
+		return a.x <= max.x && a.y <= max.y && a.z <= max.z
+		    && b.x >= min.x && b.y >= min.y && b.z >= min.z;
+	};
+
+	std::vector< uint32_t > todo;
+	todo.emplace_back(0);
+	while (!todo.empty()) {
+		Node const &node = nodes[todo.back()];
+		todo.pop_back();
+		if (!overlaps(node.min, node.max)) continue;
+		if (node.count) {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				if (overlaps(items[i].min, items[i].max)) ids->emplace_back(items[i].id);
+			}
+		} else {
+			todo.emplace_back(node.first);
+			todo.emplace_back(node.first + 1);
+		}
+	}
+}
+
+//squared distance from point to box [min,max] (zero if the point is inside):
+static float distance2(glm::vec3 const &point, glm::vec3 const &min, glm::vec3 const &max) {
+	glm::vec3 d = glm::max(glm::max(min - point, point - max), glm::vec3(0.0f));
+	return glm::dot(d, d);
+}
+
+void BVH::overlap_sphere(glm::vec3 const &center, float radius, std::vector< uint32_t > *ids) const {
+	assert(ids);
+	if (nodes.empty()) return;
+
+	float radius2 = radius * radius;
+
+	std::vector< uint32_t > todo;
+	todo.emplace_back(0);
+	while (!todo.empty()) {
+		Node const &node = nodes[todo.back()];
+		todo.pop_back();
+		if (distance2(center, node.min, node.max) > radius2) continue;
+		if (node.count) {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				if (distance2(center, items[i].min, items[i].max) <= radius2) ids->emplace_back(items[i].id);
+			}
+		} else {
+			todo.emplace_back(node.first);
+			todo.emplace_back(node.first + 1);
+		}
+	}
+}
+
+void BVH::nearest(glm::vec3 const &point, uint32_t k, float max_distance, std::vector< uint32_t > *ids, std::vector< float > *distances) const {
+	assert(ids);
+	if (nodes.empty() || k == 0) return;
+
+	//best items found so far, as a max-heap on distance (so the worst is on top, ready to be replaced):
+	struct Found {
+		float distance2;
+		uint32_t id;
+		bool operator<(Found const &o) const { return distance2 < o.distance2; }
+	};
+	std::vector< Found > found;
+	found.reserve(k + 1);
+	//items further than this can't be in the result:
+	auto limit2 = [&]() {
+		return (found.size() < k ? max_distance * max_distance : found.front().distance2);
+	};
+
+	//nodes to visit, as a min-heap on distance (so the search always continues from the closest node):
+	struct Todo {
+		float distance2;
+		uint32_t node;
+		bool operator<(Todo const &o) const { return distance2 > o.distance2; }
+	};
+	std::vector< Todo > todo;
+	todo.emplace_back(Todo{distance2(point, nodes[0].min, nodes[0].max), 0});
+	while (!todo.empty()) {
+		std::pop_heap(todo.begin(), todo.end());
+		Todo t = todo.back();
+		todo.pop_back();
+		if (t.distance2 > limit2()) break; //every remaining node is at least this far away
+		Node const &node = nodes[t.node];
+		if (node.count) {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				float d2 = distance2(point, items[i].min, items[i].max);
+				if (d2 > limit2()) continue;
+				found.emplace_back(Found{d2, items[i].id});
+				std::push_heap(found.begin(), found.end());
+				if (found.size() > k) {
+					std::pop_heap(found.begin(), found.end());
+					found.pop_back();
+				}
+			}
+		} else {
+			for (uint32_t c = node.first; c < node.first + 2; ++c) {
+				float d2 = distance2(point, nodes[c].min, nodes[c].max);
+				if (d2 > limit2()) continue;
+				todo.emplace_back(Todo{d2, c});
+				std::push_heap(todo.begin(), todo.end());
+			}
+		}
+	}
+
+	std::sort_heap(found.begin(), found.end()); //(nearest first)
+	for (auto const &f : found) {
+		ids->emplace_back(f.id);
+		if (distances) distances->emplace_back(std::sqrt(f.distance2));
+	}
+}
+
+uint32_t BVH::raycast(glm::vec3 const &origin, glm::vec3 const &direction, float max_t,
+	std::function< float(uint32_t id, float box_t) > const &hit, float *t_) const {
+
+	float best_t = max_t;
+	uint32_t best_id = -1U;
+
+	if (!nodes.empty()) {
+		glm::vec3 inv_direction = 1.0f / direction;
+
+		//distance along ray at which it enters box [min,max], or infinity if it misses (or only hits after best_t):
+		auto enter = [&](glm::vec3 const &min, glm::vec3 const &max) {
+			float t0 = 0.0f;
+			float t1 = best_t;
+			for (uint32_t i = 0; i < 3; ++i) {
+				float a = (min[i] - origin[i]) * inv_direction[i];
+				float b = (max[i] - origin[i]) * inv_direction[i];
+				//(fmin/fmax ignore the NaN from 0 * infinity when the ray lies in a slab's boundary plane)
+				t0 = std::fmax(t0, std::fmin(a, b));
+				t1 = std::fmin(t1, std::fmax(a, b));
+			}
+			return (t0 <= t1 ? t0 : std::numeric_limits< float >::infinity());
+		};
+
+		struct Todo {
+			uint32_t node;
+			float t;
+		};
+		std::vector< Todo > todo;
+		float root_t = enter(nodes[0].min, nodes[0].max);
+		if (root_t != std::numeric_limits< float >::infinity()) todo.emplace_back(Todo{0, root_t});
+		while (!todo.empty()) {
+			Todo t = todo.back();
+			todo.pop_back();
+			if (t.t > best_t) continue; //a closer hit was found since this node was queued
+			Node const &node = nodes[t.node];
+			if (node.count) {
+				for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+					float box_t = enter(items[i].min, items[i].max);
+					if (box_t > best_t) continue;
+					float item_t = hit(items[i].id, box_t);
+					if (item_t < best_t) {
+						best_t = item_t;
+						best_id = items[i].id;
+					}
+				}
+			} else {
+				//visit the nearer child first (it goes on top of the stack):
+				Todo a{node.first, enter(nodes[node.first].min, nodes[node.first].max)};
+				Todo b{node.first + 1, enter(nodes[node.first + 1].min, nodes[node.first + 1].max)};
+				if (a.t < b.t) std::swap(a, b);
+				if (a.t != std::numeric_limits< float >::infinity()) todo.emplace_back(a);
+				if (b.t != std::numeric_limits< float >::infinity()) todo.emplace_back(b);
+			}
+		}
+	}
+
+	if (t_) *t_ = best_t;
+	return best_id;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+/*
+ * A BVH is a bounding volume hierarchy over a set of axis-aligned boxes.
+ * Each box is tagged with a caller-chosen id (e.g., a drawable's slot index).
+ *
+ * The tree supports:
+ *  - frustum queries (which boxes might be visible?),
+ *  - overlap queries (which boxes touch this box?),
+ *  - raycasts (what is the closest thing along this ray?),
+ *  - sphere overlap queries (which boxes are within some distance of a point?),
+ *  - nearest-neighbor queries (which k boxes are closest to a point?),
+ *  all of which visit only the parts of the tree near the query.
+ *
+ * When boxes move, update them with set_bounds() and call refit() -- this keeps
+ *  the tree structure but grows/shrinks its nodes to fit (if only a few boxes
+ *  moved, refit(changed) just fixes the nodes above them). After many big moves
+ *  the tree may get loose (and queries slower); build() again to fix that.
+ *
+ * Usage:
+ *  BVH bvh;
+ *  bvh.build({ {min0, max0, id0}, {min1, max1, id1}, ... });
+ *  std::vector< uint32_t > visible;
+ *  bvh.frustum(world_to_clip, &visible);
+ *
+ */
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+struct BVH {
+	struct Item {
+		glm::vec3 min;
+		glm::vec3 max;
+		uint32_t id;
+	};
+
+	//build tree over the given items (replaces any previous contents):
+	void build(std::vector< Item > const &items);
+
+	//remove all items:
+	void clear();
+
+	//change the bounds of an item (by its index in 'items' -- build() reorders items, so look ids up there):
+	// (call refit() after changing bounds and before the next query)
+	void set_bounds(uint32_t item, glm::vec3 const &min, glm::vec3 const &max);
+
+	//recompute node bounds from item bounds:
+	void refit();
+	//..only for the nodes above some items (by index in 'items'), which is quicker when few items have changed:
+	void refit(std::vector< uint32_t > const &changed);
+
+	//--- queries ---
+	// (results are appended to 'ids' in no particular order)
+
+	//ids of all items that might be inside the view volume of world_to_clip:
+	// (items are tested against the six clip planes, so some items near frustum corners are reported even though they are outside)
+	void frustum(glm::mat4 const &world_to_clip, std::vector< uint32_t > *ids) const;
+
+	//ids of all items whose boxes overlap [min,max]:
+	void overlap(glm::vec3 const &min, glm::vec3 const &max, std::vector< uint32_t > *ids) const;
+
+	//ids of all items whose boxes are within radius of center:
+	void overlap_sphere(glm::vec3 const &center, float radius, std::vector< uint32_t > *ids) const;
+
+	//ids of the (up to) k items whose boxes are closest to point (and no further than max_distance), nearest first:
+	// (the distance to a box containing the point is zero; if distances is non-null, each id's distance is appended to it)
+	void nearest(glm::vec3 const &point, uint32_t k, float max_distance, std::vector< uint32_t > *ids, std::vector< float > *distances = nullptr) const;
+
+	//closest item along the ray from origin in direction (not necessarily normalized), up to distance max_t (in units of direction):
+	// 'hit' is called for items whose boxes the ray enters before the current closest hit;
+	//  it should return the distance at which the ray actually hits that item, or infinity for a miss
+	//  (so callers can test against something tighter than the box -- or just return the box distance it is passed)
+	// returns the id of the closest hit item (or -1U for no hit), and sets *t to its distance
+	uint32_t raycast(glm::vec3 const &origin, glm::vec3 const &direction, float max_t,
+		std::function< float(uint32_t id, float box_t) > const &hit, float *t = nullptr) const;
+
+	uint32_t size() const { return uint32_t(items.size()); }
+
+	//--- internals ---
+
+	//items, reordered so that each leaf refers to a contiguous range:
+	std::vector< Item > items;
+
+	struct Node {
+		glm::vec3 min = glm::vec3(0.0f);
+		uint32_t first = 0; //index of first child node (children are first and first+1) or, for leaves, first item
+		glm::vec3 max = glm::vec3(0.0f);
+		uint32_t count = 0; //number of items in a leaf; 0 for interior nodes
+	};
+	//nodes[0] is the root; children always have larger indices than their parents:
+	std::vector< Node > nodes;
+	std::vector< uint32_t > parents; //per node; -1U for the root
+	std::vector< uint32_t > leaves; //per item, the leaf node that holds it
+
+	enum : uint32_t { LeafSize = 4 }; //leaves hold at most this many items
+};
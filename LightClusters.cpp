@@ -0,0 +1,123 @@
+#include "LightClusters.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+static uint32_t tile(float ndc, uint32_t tiles) {
+	float t = std::floor((ndc * 0.5f + 0.5f) * float(tiles));
+	return uint32_t(std::min(std::max(t, 0.0f), float(tiles - 1)));
+}
+
+static uint32_t slice(float w) {
+	//(written to match the shader: floor(log(w / near) * Slices / log(far / near)))
+	float s = std::floor(std::log(w / LightClusters::SliceNear) * (float(LightClusters::Slices) / std::log(LightClusters::SliceFar / LightClusters::SliceNear)));
+	if (!(s >= 0.0f)) return 0; //(also catches NaN from w <= 0)
+	return uint32_t(std::min(s, float(LightClusters::Slices - 1)));
+}
+
+uint32_t LightClusters::cluster_index(glm::vec2 const &ndc, float w) {
+	return (slice(w) * TilesY + tile(ndc.y, TilesY)) * TilesX + tile(ndc.x, TilesX);
+}
+
+void LightClusters::build(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light, std::vector< Light > const &lights, uint32_t max_indices) {
+	lights_data.clear();
+	ranges.assign(Count, glm::uvec2(0));
+	indices.clear();
+	dropped = 0;
+
+	//clusters touched by each light, as an inclusive box of tile/slice coordinates:
+	struct Box {
+		uint32_t light;
+		glm::uvec3 min, max;
+	};
+	std::vector< Box > boxes;
+	boxes.reserve(lights.size());
+
+	glm::vec4 w_row = glm::transpose(world_to_clip)[3]; //clip w of p is dot(w_row, vec4(p,1))
+	float w_scale = glm::length(glm::vec3(w_row)); //largest change in w per unit distance
+
+	for (auto const &light : lights) {
+		Box box{uint32_t(boxes.size()), glm::uvec3(0), glm::uvec3(TilesX - 1, TilesY - 1, Slices - 1)};
+
+		bool bounded = (light.range > 0.0f && (light.type == Light::Point || light.type == Light::Spot));
+		if (bounded) {
+			float r = light.range;
+			float w = glm::dot(w_row, glm::vec4(light.position, 1.0f));
+			float w_min = w - r * w_scale;
+			float w_max = w + r * w_scale;
+			if (w_max <= 0.0f) continue; //entirely behind the camera
+
+			//screen-space extent from the corners of the sphere's bounding box:
+			// (if any corner is behind the camera the projection wraps around, so use the whole screen)
+			glm::vec2 ndc_min = glm::vec2( 1e30f);
+			glm::vec2 ndc_max = glm::vec2(-1e30f);
+			bool all_in_front = true;
+			for (uint32_t c = 0; c < 8; ++c) {
+				glm::vec3 corner = light.position + r * glm::vec3((c & 1) ? 1.0f : -1.0f, (c & 2) ? 1.0f : -1.0f, (c & 4) ? 1.0f : -1.0f);
+				glm::vec4 clip = world_to_clip * glm::vec4(corner, 1.0f);
+				if (clip.w <= 0.0f) {
+					all_in_front = false;
+					break;
+				}
+				glm::vec2 ndc = glm::vec2(clip) / clip.w;
+				ndc_min = glm::min(ndc_min, ndc);
+				ndc_max = glm::max(ndc_max, ndc);
+			}
+			if (all_in_front) {
+				if (ndc_max.x < -1.0f || ndc_min.x > 1.0f || ndc_max.y < -1.0f || ndc_min.y > 1.0f) continue; //off screen
+				box.min.x = tile(ndc_min.x, TilesX);
+				box.max.x = tile(ndc_max.x, TilesX);
+				box.min.y = tile(ndc_min.y, TilesY);
+				box.max.y = tile(ndc_max.y, TilesY);
+			}
+			box.min.z = slice(w_min);
+			box.max.z = slice(w_max);
+		}
+
+		//light data, in the order the shader reads it:
+		lights_data.emplace_back(world_to_light * glm::vec4(light.position, 1.0f), float(light.type));
+		lights_data.emplace_back(world_to_light * glm::vec4(light.direction, 0.0f), bounded ? light.range : 0.0f);
+		lights_data.emplace_back(light.energy, light.cutoff);
+
+		boxes.emplace_back(box);
+	}
+
+	//count lights in each cluster:
+	for (auto const &box : boxes) {
+		for (uint32_t z = box.min.z; z <= box.max.z; ++z) {
+			for (uint32_t y = box.min.y; y <= box.max.y; ++y) {
+				for (uint32_t x = box.min.x; x <= box.max.x; ++x) {
+					ranges[(z * TilesY + y) * TilesX + x].y += 1;
+				}
+			}
+		}
+	}
+
+	//lay out clusters' lists one after another (dropping lights from clusters that don't fit):
+	uint32_t total = 0;
+	for (auto &range : ranges) {
+		range.x = total;
+		if (range.y > max_indices - total) {
+			dropped += range.y - (max_indices - total);
+			range.y = max_indices - total;
+		}
+		total += range.y;
+	}
+	indices.resize(total);
+
+	//fill in lists (re-counting each cluster as it is filled):
+	std::vector< uint32_t > filled(Count, 0);
+	for (auto const &box : boxes) {
+		for (uint32_t z = box.min.z; z <= box.max.z; ++z) {
+			for (uint32_t y = box.min.y; y <= box.max.y; ++y) {
+				for (uint32_t x = box.min.x; x <= box.max.x; ++x) {
+					uint32_t c = (z * TilesY + y) * TilesX + x;
+					if (filled[c] < ranges[c].y) {
+						indices[ranges[c].x + filled[c]] = box.light;
+						filled[c] += 1;
+					}
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+/*
+ * LightClusters bins lights into a grid of "clusters" covering the view volume,
+ *  so that shaders only loop over the lights that can reach each fragment.
+ *
+ * Clusters are TilesX x TilesY tiles in normalized device coordinates, and
+ *  Slices slices in view depth (clip-space w), spaced exponentially between
+ *  SliceNear and SliceFar (anything nearer/further goes in the first/last slice).
+ *
+ * Lights with a range are added to the clusters their bounding sphere touches;
+ *  lights without a range (and hemisphere/directional lights) are added to every cluster.
+ *
+ * Usage:
+ *  LightClusters clusters;
+ *  clusters.build(world_to_clip, world_to_light, lights); //lights in world space
+ *  //...upload clusters.lights_data, clusters.ranges, and clusters.indices to the GPU
+ *
+ * Shaders find a fragment's cluster with the same formula as cluster_index() (see LitColorTextureProgram.cpp).
+ *
+ */
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct LightClusters {
+	enum : uint32_t {
+		TilesX = 16,
+		TilesY = 9,
+		Slices = 24,
+		Count = TilesX * TilesY * Slices,
+	};
+	static constexpr float SliceNear = 0.1f;
+	static constexpr float SliceFar = 1000.0f;
+
+	//A light, as passed to build() (the shader's LIGHT_TYPE numbering):
+	struct Light {
+		enum Type : uint32_t {
+			Point = 0,
+			Hemisphere = 1,
+			Spot = 2,
+			Directional = 3,
+		} type = Point;
+		glm::vec3 position = glm::vec3(0.0f); //world space
+		glm::vec3 direction = glm::vec3(0.0f, 0.0f, -1.0f); //world space; hemisphere, spot, and directional lights
+		glm::vec3 energy = glm::vec3(1.0f);
+		float cutoff = 0.0f; //cosine of half the spot cone angle; spot lights only
+		float range = 0.0f; //no effect beyond this distance (point and spot lights; 0 means unlimited)
+	};
+
+	//bin lights into clusters of the view volume of world_to_clip:
+	// (replaces the previous contents; at most max_indices cluster-light pairs are stored -- past that, lights are dropped)
+	// lights_data is stored relative to world_to_light (which should be a rigid transform, so ranges stay the same)
+	void build(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light, std::vector< Light > const &lights, uint32_t max_indices = -1U);
+
+	//cluster containing a point with the given normalized device x,y and clip-space w:
+	static uint32_t cluster_index(glm::vec2 const &ndc, float w);
+
+	//--- results ---
+
+	//per light (in light space), three vec4s: (position, type), (direction, range), (energy, cutoff):
+	std::vector< glm::vec4 > lights_data;
+	//per cluster, (first, count) of its entries in indices:
+	std::vector< glm::uvec2 > ranges;
+	//light numbers (in lights_data), grouped by cluster:
+	std::vector< uint32_t > indices;
+
+	uint32_t dropped = 0; //cluster-light pairs that didn't fit in max_indices
+};
@@ -1,5 +1,6 @@
 #include "LitColorTextureProgram.hpp"
 
+#include "LightClusters.hpp"
 #include "gl_compile_program.hpp"
 #include "gl_errors.hpp"
 
@@ -15,13 +16,8 @@ Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> L
 	lit_color_texture_program_pipeline.OBJECT_TO_LIGHT_mat4x3 = ret->OBJECT_TO_LIGHT_mat4x3;
 	lit_color_texture_program_pipeline.NORMAL_TO_LIGHT_mat3 = ret->NORMAL_TO_LIGHT_mat3;
 
-	/* This will be used later if/when we build a light loop into the Scene:
-	lit_color_texture_program_pipeline.LIGHT_TYPE_int = ret->LIGHT_TYPE_int;
-	lit_color_texture_program_pipeline.LIGHT_LOCATION_vec3 = ret->LIGHT_LOCATION_vec3;
-	lit_color_texture_program_pipeline.LIGHT_DIRECTION_vec3 = ret->LIGHT_DIRECTION_vec3;
-	lit_color_texture_program_pipeline.LIGHT_ENERGY_vec3 = ret->LIGHT_ENERGY_vec3;
-	lit_color_texture_program_pipeline.LIGHT_CUTOFF_float = ret->LIGHT_CUTOFF_float;
-	*/
+	//lights come from the scene (see Scene::Drawable::Pipeline::uses_lights):
+	lit_color_texture_program_pipeline.uses_lights = true;
 
 	//make a 1-pixel white texture to bind by default:
 	GLuint tex;
@@ -43,64 +39,139 @@ Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> L
 	return ret;
 });
 
-LitColorTextureProgram::LitColorTextureProgram() {
-	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
-	program = gl_compile_program(
-		//vertex shader:
-		"#version 330\n"
-		"uniform mat4 OBJECT_TO_CLIP;\n"
-		"uniform mat4x3 OBJECT_TO_LIGHT;\n"
-		"uniform mat3 NORMAL_TO_LIGHT;\n"
-		"in vec4 Position;\n"
-		"in vec3 Normal;\n"
-		"in vec4 Color;\n"
-		"in vec2 TexCoord;\n"
+//(loaded after lit_color_texture_program, since it fills in more of the pipeline template)
+Load< LitColorTextureProgram > lit_color_texture_program_instanced(LoadTagEarly, []() -> LitColorTextureProgram const * {
+	LitColorTextureProgram *ret = new LitColorTextureProgram(true);
+
+	lit_color_texture_program_pipeline.instanced_program = ret->program;
+	lit_color_texture_program_pipeline.INSTANCE_FIRST_int = ret->INSTANCE_FIRST_int;
+	lit_color_texture_program_pipeline.WORLD_TO_CLIP_mat4 = ret->WORLD_TO_CLIP_mat4;
+	lit_color_texture_program_pipeline.WORLD_TO_LIGHT_mat4x3 = ret->WORLD_TO_LIGHT_mat4x3;
+
+	return ret;
+});
+
+LitColorTextureProgram::LitColorTextureProgram(bool instanced) {
+	//attribute locations are fixed (with layout qualifiers) so that both variants can share vertex array objects:
+	std::string attributes =
+		"layout(location=0) in vec4 Position;\n"
+		"layout(location=1) in vec3 Normal;\n"
+		"layout(location=2) in vec4 Color;\n"
+		"layout(location=3) in vec2 TexCoord;\n"
 		"out vec3 position;\n"
 		"out vec3 normal;\n"
 		"out vec4 color;\n"
 		"out vec2 texCoord;\n"
-		"void main() {\n"
-		"	gl_Position = OBJECT_TO_CLIP * Position;\n"
-		"	position = OBJECT_TO_LIGHT * Position;\n"
-		"	normal = NORMAL_TO_LIGHT * Normal;\n"
-		"	color = Color;\n"
-		"	texCoord = TexCoord;\n"
-		"}\n"
+		"out vec4 clipPosition;\n" //(for finding light clusters)
+	;
+
+	std::string vertex_shader;
+	if (!instanced) {
+		vertex_shader =
+			"#version 330\n"
+			"uniform mat4 OBJECT_TO_CLIP;\n"
+			"uniform mat4x3 OBJECT_TO_LIGHT;\n"
+			"uniform mat3 NORMAL_TO_LIGHT;\n"
+			+ attributes +
+			"void main() {\n"
+			"	gl_Position = OBJECT_TO_CLIP * Position;\n"
+			"	clipPosition = gl_Position;\n"
+			"	position = OBJECT_TO_LIGHT * Position;\n"
+			"	normal = NORMAL_TO_LIGHT * Normal;\n"
+			"	color = Color;\n"
+			"	texCoord = TexCoord;\n"
+			"}\n"
+		;
+	} else {
+		//same as above, but object matrices are fetched from INSTANCES (see Scene::Drawable::Pipeline for the layout):
+		// (world-to-clip and world-to-light are shared by all instances, so they are uniforms)
+		vertex_shader =
+			"#version 330\n"
+			"uniform mat4 WORLD_TO_CLIP;\n"
+			"uniform mat4x3 WORLD_TO_LIGHT;\n"
+			"uniform samplerBuffer INSTANCES;\n"
+			"uniform usamplerBuffer INSTANCE_SLOTS;\n"
+			"uniform int INSTANCE_FIRST;\n"
+			+ attributes +
+			"void main() {\n"
+			"	int i = int(texelFetch(INSTANCE_SLOTS, INSTANCE_FIRST + gl_InstanceID).x) * " + std::to_string(Scene::Drawable::Pipeline::InstanceTexels) + ";\n"
+			"	mat4x3 OBJECT_TO_WORLD = transpose(mat3x4(texelFetch(INSTANCES, i+0), texelFetch(INSTANCES, i+1), texelFetch(INSTANCES, i+2)));\n"
+			"	mat3 NORMAL_TO_WORLD = mat3(texelFetch(INSTANCES, i+3).xyz, texelFetch(INSTANCES, i+4).xyz, texelFetch(INSTANCES, i+5).xyz);\n"
+			"	vec4 world = vec4(OBJECT_TO_WORLD * Position, 1.0);\n"
+			"	gl_Position = WORLD_TO_CLIP * world;\n"
+			"	clipPosition = gl_Position;\n"
+			"	position = WORLD_TO_LIGHT * world;\n"
+			"	normal = mat3(WORLD_TO_LIGHT) * (NORMAL_TO_WORLD * Normal);\n" //(world-to-light is rigid, so is its own normal matrix)
+			"	color = Color;\n"
+			"	texCoord = TexCoord;\n"
+			"}\n"
+		;
+	}
+
+	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
+	program = gl_compile_program(
+		//vertex shader:
+		vertex_shader
 	,
 		//fragment shader:
+		// (loops over the lights in this fragment's cluster -- see LightClusters.hpp for how clusters are laid out)
 		"#version 330\n"
 		"uniform sampler2D TEX;\n"
-		"uniform int LIGHT_TYPE;\n"
-		"uniform vec3 LIGHT_LOCATION;\n"
-		"uniform vec3 LIGHT_DIRECTION;\n"
-		"uniform vec3 LIGHT_ENERGY;\n"
-		"uniform float LIGHT_CUTOFF;\n"
+		"uniform samplerBuffer LIGHTS;\n"
+		"uniform usamplerBuffer LIGHT_RANGES;\n"
+		"uniform usamplerBuffer LIGHT_INDICES;\n"
 		"in vec3 position;\n"
 		"in vec3 normal;\n"
 		"in vec4 color;\n"
 		"in vec2 texCoord;\n"
+		"in vec4 clipPosition;\n"
 		"out vec4 fragColor;\n"
+		"const int TILES_X = " + std::to_string(LightClusters::TilesX) + ";\n"
+		"const int TILES_Y = " + std::to_string(LightClusters::TilesY) + ";\n"
+		"const int SLICES = " + std::to_string(LightClusters::Slices) + ";\n"
+		"const float SLICE_NEAR = " + std::to_string(LightClusters::SliceNear) + ";\n"
+		"const float SLICE_FAR = " + std::to_string(LightClusters::SliceFar) + ";\n"
+		"int cluster_index() {\n"
+		"	vec2 ndc = clipPosition.xy / clipPosition.w;\n"
+		"	ivec2 tile = clamp(ivec2(floor((ndc * 0.5 + 0.5) * vec2(TILES_X, TILES_Y))), ivec2(0), ivec2(TILES_X-1, TILES_Y-1));\n"
+		"	int slice = clamp(int(floor(log(clipPosition.w / SLICE_NEAR) * (float(SLICES) / log(SLICE_FAR / SLICE_NEAR)))), 0, SLICES-1);\n"
+		"	return (slice * TILES_Y + tile.y) * TILES_X + tile.x;\n"
+		"}\n"
 		"void main() {\n"
 		"	vec3 n = normalize(normal);\n"
-		"	vec3 e;\n"
-		"	if (LIGHT_TYPE == 0) { //point light \n"
-		"		vec3 l = (LIGHT_LOCATION - position);\n"
-		"		float dis2 = dot(l,l);\n"
-		"		l = normalize(l);\n"
-		"		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
-		"		e = nl * LIGHT_ENERGY;\n"
-		"	} else if (LIGHT_TYPE == 1) { //hemi light \n"
-		"		e = (dot(n,-LIGHT_DIRECTION) * 0.5 + 0.5) * LIGHT_ENERGY;\n"
-		"	} else if (LIGHT_TYPE == 2) { //spot light \n"
-		"		vec3 l = (LIGHT_LOCATION - position);\n"
-		"		float dis2 = dot(l,l);\n"
-		"		l = normalize(l);\n"
-		"		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
-		"		float c = dot(l,-LIGHT_DIRECTION);\n"
-		"		nl *= smoothstep(LIGHT_CUTOFF,mix(LIGHT_CUTOFF,1.0,0.1), c);\n"
-		"		e = nl * LIGHT_ENERGY;\n"
-		"	} else { //(LIGHT_TYPE == 3) //directional light \n"
-		"		e = max(0.0, dot(n,-LIGHT_DIRECTION)) * LIGHT_ENERGY;\n"
+		"	vec3 e = vec3(0.0);\n"
+		"	uvec2 range = texelFetch(LIGHT_RANGES, cluster_index()).xy;\n"
+		"	for (uint i = range.x; i < range.x + range.y; ++i) {\n"
+		"		int light = int(texelFetch(LIGHT_INDICES, int(i)).x) * 3;\n"
+		"		vec4 a = texelFetch(LIGHTS, light);\n"
+		"		vec4 b = texelFetch(LIGHTS, light+1);\n"
+		"		vec4 c = texelFetch(LIGHTS, light+2);\n"
+		"		int LIGHT_TYPE = int(a.w);\n"
+		"		vec3 LIGHT_LOCATION = a.xyz;\n"
+		"		vec3 LIGHT_DIRECTION = b.xyz;\n"
+		"		float LIGHT_RANGE = b.w;\n"
+		"		vec3 LIGHT_ENERGY = c.rgb;\n"
+		"		float LIGHT_CUTOFF = c.w;\n"
+		"		if (LIGHT_TYPE == 0 || LIGHT_TYPE == 2) { //point or spot light \n"
+		"			vec3 l = (LIGHT_LOCATION - position);\n"
+		"			float dis2 = dot(l,l);\n"
+		"			l = normalize(l);\n"
+		"			float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
+		"			if (LIGHT_RANGE > 0.0) { //fade to zero at range \n"
+		"				float f = dis2 / (LIGHT_RANGE * LIGHT_RANGE);\n"
+		"				float w = clamp(1.0 - f * f, 0.0, 1.0);\n"
+		"				nl *= w * w;\n"
+		"			}\n"
+		"			if (LIGHT_TYPE == 2) { //spot cone \n"
+		"				float s = dot(l,-LIGHT_DIRECTION);\n"
+		"				nl *= smoothstep(LIGHT_CUTOFF,mix(LIGHT_CUTOFF,1.0,0.1), s);\n"
+		"			}\n"
+		"			e += nl * LIGHT_ENERGY;\n"
+		"		} else if (LIGHT_TYPE == 1) { //hemi light \n"
+		"			e += (dot(n,-LIGHT_DIRECTION) * 0.5 + 0.5) * LIGHT_ENERGY;\n"
+		"		} else { //(LIGHT_TYPE == 3) //directional light \n"
+		"			e += max(0.0, dot(n,-LIGHT_DIRECTION)) * LIGHT_ENERGY;\n"
+		"		}\n"
 		"	}\n"
 		"	vec4 albedo = texture(TEX, texCoord) * color;\n"
 		"	fragColor = vec4(e*albedo.rgb, albedo.a);\n"
@@ -120,19 +191,30 @@ LitColorTextureProgram::LitColorTextureProgram() {
 	OBJECT_TO_LIGHT_mat4x3 = glGetUniformLocation(program, "OBJECT_TO_LIGHT");
 	NORMAL_TO_LIGHT_mat3 = glGetUniformLocation(program, "NORMAL_TO_LIGHT");
 
-	LIGHT_TYPE_int = glGetUniformLocation(program, "LIGHT_TYPE");
-	LIGHT_LOCATION_vec3 = glGetUniformLocation(program, "LIGHT_LOCATION");
-	LIGHT_DIRECTION_vec3 = glGetUniformLocation(program, "LIGHT_DIRECTION");
-	LIGHT_ENERGY_vec3 = glGetUniformLocation(program, "LIGHT_ENERGY");
-	LIGHT_CUTOFF_float = glGetUniformLocation(program, "LIGHT_CUTOFF");
-
+	INSTANCE_FIRST_int = glGetUniformLocation(program, "INSTANCE_FIRST");
+	WORLD_TO_CLIP_mat4 = glGetUniformLocation(program, "WORLD_TO_CLIP");
+	WORLD_TO_LIGHT_mat4x3 = glGetUniformLocation(program, "WORLD_TO_LIGHT");
 
 	GLuint TEX_sampler2D = glGetUniformLocation(program, "TEX");
+	GLuint INSTANCES_samplerBuffer = glGetUniformLocation(program, "INSTANCES");
+	GLuint INSTANCE_SLOTS_usamplerBuffer = glGetUniformLocation(program, "INSTANCE_SLOTS");
+	GLuint LIGHTS_samplerBuffer = glGetUniformLocation(program, "LIGHTS");
+	GLuint LIGHT_RANGES_usamplerBuffer = glGetUniformLocation(program, "LIGHT_RANGES");
+	GLuint LIGHT_INDICES_usamplerBuffer = glGetUniformLocation(program, "LIGHT_INDICES");
 
 	//set TEX to always refer to texture binding zero:
 	glUseProgram(program); //bind program -- glUniform* calls refer to this program now
 
 	glUniform1i(TEX_sampler2D, 0); //set TEX to sample from GL_TEXTURE0
+	if (instanced) {
+		//(where Scene::draw binds instance data)
+		glUniform1i(INSTANCES_samplerBuffer, Scene::Drawable::Pipeline::InstancesTextureUnit);
+		glUniform1i(INSTANCE_SLOTS_usamplerBuffer, Scene::Drawable::Pipeline::InstanceSlotsTextureUnit);
+	}
+	//(where Scene::draw binds light cluster data)
+	glUniform1i(LIGHTS_samplerBuffer, Scene::Drawable::Pipeline::LightsTextureUnit);
+	glUniform1i(LIGHT_RANGES_usamplerBuffer, Scene::Drawable::Pipeline::LightRangesTextureUnit);
+	glUniform1i(LIGHT_INDICES_usamplerBuffer, Scene::Drawable::Pipeline::LightIndicesTextureUnit);
 
 	glUseProgram(0); //unbind program -- glUniform* calls refer to ??? now
 }
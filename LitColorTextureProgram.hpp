@@ -5,8 +5,10 @@
 #include "Scene.hpp"
 
 //Shader program that draws transformed, lit, textured vertices tinted with vertex colors:
+// the 'instanced' variant draws many copies of the same vertices, reading per-instance matrices from a buffer texture
+// (see Scene::Drawable::Pipeline::instanced_program for the layout)
 struct LitColorTextureProgram {
-	LitColorTextureProgram();
+	LitColorTextureProgram(bool instanced = false);
 	~LitColorTextureProgram();
 
 	GLuint program = 0;
@@ -21,20 +23,27 @@ struct LitColorTextureProgram {
 	GLuint OBJECT_TO_CLIP_mat4 = -1U;
 	GLuint OBJECT_TO_LIGHT_mat4x3 = -1U;
 	GLuint NORMAL_TO_LIGHT_mat3 = -1U;
+	//(instanced variant has these instead of the three matrices above)
+	GLuint INSTANCE_FIRST_int = -1U;
+	GLuint WORLD_TO_CLIP_mat4 = -1U;
+	GLuint WORLD_TO_LIGHT_mat4x3 = -1U;
 
 	//lighting:
-	GLuint LIGHT_TYPE_int = -1U;
-	GLuint LIGHT_LOCATION_vec3 = -1U;
-	GLuint LIGHT_DIRECTION_vec3 = -1U;
-	GLuint LIGHT_ENERGY_vec3 = -1U;
-	GLuint LIGHT_CUTOFF_float = -1U;
-	
+	// lights come from the Scene being drawn, which bins them into clusters and binds them as buffer textures
+	// (see Scene::Drawable::Pipeline::uses_lights)
+
 	//Textures:
 	//TEXTURE0 - texture that is accessed by TexCoord
+	//TEXTURE4 - (instanced variant) per-instance matrices, a GL_TEXTURE_BUFFER
+	//TEXTURE5-7 - light cluster data, GL_TEXTURE_BUFFERs
+	//TEXTURE8 - (instanced variant) matrix slot for each instance, a GL_TEXTURE_BUFFER
 };
 
 extern Load< LitColorTextureProgram > lit_color_texture_program;
+//NOTE: attribute locations are the same in both variants, so vaos made for one work with the other.
+extern Load< LitColorTextureProgram > lit_color_texture_program_instanced;
 
 //For convenient scene-graph setup, copy this object:
 // NOTE: by default, has texture bound to 1-pixel white texture -- so it's okay to use with vertex-color-only meshes.
+// NOTE: also has instanced_program set to lit_color_texture_program_instanced.
 extern Scene::Drawable::Pipeline lit_color_texture_program_pipeline;
@@ -0,0 +1,38 @@
+#pragma once
+
+/*
+ * A MappedFile maps a whole file into (read-only) memory, so its contents can
+ *  be read in place instead of being copied out through a stream.
+ *
+ * Pages are only read from disk when they are first touched, so loading code
+ *  that walks the file once pays mostly for page faults.
+ *
+ * Usage:
+ *  MappedFile file("level.scene"); //throws if the file can't be opened or mapped
+ *  char const *at = file.begin(); //..file.end() -- valid until 'file' is destroyed
+ *
+ */
+
+#include <cstddef>
+#include <string>
+
+struct MappedFile {
+	MappedFile(std::string const &filename);
+	~MappedFile();
+
+	//since the destructor unmaps the file, copying a MappedFile is not advised:
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+
+	char const *begin() const { return data; }
+	char const *end() const { return data + size; }
+
+	char const *data = nullptr; //(nullptr for empty files)
+	size_t size = 0;
+
+	//platform-specific handles:
+	#ifdef _WIN32
+	void *file_handle = nullptr;
+	void *mapping_handle = nullptr;
+	#endif
+};
@@ -47,10 +47,47 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		throw std::runtime_error("Unknown file type '" + filename + "'");
 	}
 
+	//read + upload (optional) indices, widened to 32 bits for checking:
+	GLenum index_type = GL_NONE;
+	std::vector< uint32_t > indices;
+	{
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		std::streampos at = file.tellg();
+		file.read(magic, 4);
+		file.clear();
+		file.seekg(at);
+
+		if (std::string(magic, 4) == "ix16") {
+			std::vector< uint16_t > indices16;
+			read_chunk(file, "ix16", &indices16);
+			index_type = GL_UNSIGNED_SHORT;
+			indices.assign(indices16.begin(), indices16.end());
+			glGenBuffers(1, &index_buffer);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices16.size() * sizeof(uint16_t), indices16.data(), GL_STATIC_DRAW);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		} else if (std::string(magic, 4) == "ix32") {
+			read_chunk(file, "ix32", &indices);
+			index_type = GL_UNSIGNED_INT;
+			glGenBuffers(1, &index_buffer);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		}
+	}
+
 	std::vector< char > strings;
 	read_chunk(file, "str0", &strings);
 
-	{ //read index chunk, add to meshes:
+	auto add_mesh = [&](uint32_t name_begin, uint32_t name_end, Mesh const &mesh) {
+		std::string name(&strings[0] + name_begin, &strings[0] + name_end);
+		bool inserted = meshes.insert(std::make_pair(name, mesh)).second;
+		if (!inserted) {
+			std::cerr << "WARNING: mesh name '" + name + "' in filename '" + filename + "' collides with existing mesh." << std::endl;
+		}
+	};
+
+	if (index_type == GL_NONE) { //read index chunk, add to meshes:
 		struct IndexEntry {
 			uint32_t name_begin, name_end;
 			uint32_t vertex_begin, vertex_end;
@@ -67,7 +104,6 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
 				throw std::runtime_error("index entry has out-of-range vertex start/count");
 			}
-			std::string name(&strings[0] + entry.name_begin, &strings[0] + entry.name_end);
 			Mesh mesh;
 			mesh.type = GL_TRIANGLES;
 			mesh.start = entry.vertex_begin;
@@ -76,10 +112,48 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 				mesh.min = glm::min(mesh.min, data[v].Position);
 				mesh.max = glm::max(mesh.max, data[v].Position);
 			}
-			bool inserted = meshes.insert(std::make_pair(name, mesh)).second;
-			if (!inserted) {
-				std::cerr << "WARNING: mesh name '" + name + "' in filename '" + filename + "' collides with existing mesh." << std::endl;
+			add_mesh(entry.name_begin, entry.name_end, mesh);
+		}
+	} else { //read indexed index chunk (which also has ranges of indices), add to meshes:
+		struct IndexEntry {
+			uint32_t name_begin, name_end;
+			uint32_t vertex_begin, vertex_end;
+			uint32_t index_begin, index_end;
+		};
+		static_assert(sizeof(IndexEntry) == 24, "Index entry should be packed");
+
+		std::vector< IndexEntry > index;
+		read_chunk(file, "idx1", &index);
+
+		for (auto const &entry : index) {
+			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
+				throw std::runtime_error("index entry has out-of-range name begin/end");
+			}
+			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
+				throw std::runtime_error("index entry has out-of-range vertex start/count");
+			}
+			if (!(entry.index_begin <= entry.index_end && entry.index_end <= indices.size())) {
+				throw std::runtime_error("index entry has out-of-range index start/count");
+			}
+			if (entry.vertex_begin > uint32_t(std::numeric_limits< GLint >::max())) {
+				throw std::runtime_error("index entry has vertex start too large for a base vertex");
 			}
+			Mesh mesh;
+			mesh.type = GL_TRIANGLES;
+			mesh.start = entry.index_begin;
+			mesh.count = entry.index_end - entry.index_begin;
+			mesh.index_type = index_type;
+			mesh.base_vertex = GLint(entry.vertex_begin);
+			//indices are relative to the mesh's first vertex, and must stay within its vertices:
+			for (uint32_t i = entry.index_begin; i < entry.index_end; ++i) {
+				if (indices[i] >= entry.vertex_end - entry.vertex_begin) {
+					throw std::runtime_error("index entry has index past the end of its vertices");
+				}
+				glm::vec3 const &position = data[entry.vertex_begin + indices[i]].Position;
+				mesh.min = glm::min(mesh.min, position);
+				mesh.max = glm::max(mesh.max, position);
+			}
+			add_mesh(entry.name_begin, entry.name_end, mesh);
 		}
 	}
 
@@ -106,6 +180,16 @@ const Mesh &MeshBuffer::lookup(std::string const &name) const {
 	return f->second;
 }
 
+std::vector< Mesh const * > MeshBuffer::lookup_lods(std::string const &name) const {
+	std::vector< Mesh const * > lods;
+	while (true) {
+		auto f = meshes.find(name + ".LOD" + std::to_string(lods.size() + 1));
+		if (f == meshes.end()) break;
+		lods.emplace_back(&f->second);
+	}
+	return lods;
+}
+
 GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
 	//create a new vertex array object:
 	GLuint vao = 0;
@@ -128,6 +212,9 @@ GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
 	bind_attribute("Color", Color);
 	bind_attribute("TexCoord", TexCoord);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	if (index_buffer != 0) {
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer); //(element array binding is part of vao state, so this stays bound to vao)
+	}
 	glBindVertexArray(0);
 
 	//Check that all active attributes were bound:
@@ -7,6 +7,11 @@
  *  a single OpenGL array buffer. Individual meshes can be looked up by name
  *  using the MeshBuffer::lookup() function.
  *
+ * Mesh files may also be indexed: the vertex chunk is followed by a chunk of
+ *  16-bit ("ix16") or 32-bit ("ix32") indices, kept in a second (element array)
+ *  buffer, and meshes are ranges of indices (drawn with glDrawElementsBaseVertex)
+ *  into their own ranges of vertices.
+ *
  */
 
 #include "GL.hpp"
@@ -14,14 +19,19 @@
 #include <map>
 #include <limits>
 #include <string>
+#include <vector>
 
 
 struct Mesh {
 	//Meshes are vertex ranges (and primitive types) in their MeshBuffer:
 
 	GLenum type = GL_TRIANGLES; //type of primitives in mesh
-	GLuint start = 0; //index of first vertex
-	GLuint count = 0; //count of vertices
+	GLuint start = 0; //index of first vertex (if indexed: of first index)
+	GLuint count = 0; //count of vertices (if indexed: of indices)
+
+	//Indexed meshes:
+	GLenum index_type = GL_NONE; //GL_UNSIGNED_SHORT or GL_UNSIGNED_INT if indexed
+	GLint base_vertex = 0; //added to each index (the mesh's first vertex)
 
 	//Bounding box.
 	//useful for debug visualization and (perhaps, eventually) collision detection:
@@ -37,13 +47,20 @@ struct MeshBuffer {
 	//look up a particular mesh by name:
 	// note: will throw if mesh not found.
 	const Mesh &lookup(std::string const &name) const;
+
+	//look up simpler versions of a mesh, named "name.LOD1", "name.LOD2", ...:
+	// (stops at the first level that doesn't exist; so, empty if there are none)
+	std::vector< Mesh const * > lookup_lods(std::string const &name) const;
 	
 	//build a vertex array object that links this vbo to attributes to a program:
+	// (and binds the index buffer, if there is one)
 	// note: will throw if program defines attributes not contained in this buffer
 	GLuint make_vao_for_program(GLuint program) const;
 
 	//This is the OpenGL vertex buffer object containing the mesh data:
 	GLuint buffer = 0;
+	//...and the element array buffer containing indices (0 if the file isn't indexed):
+	GLuint index_buffer = 0;
 
 	//-- internals ---
 
@@ -0,0 +1,243 @@
+#include "OcclusionBuffer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define OCCLUSION_BUFFER_SSE
+#endif
+
+//triangles are clipped to w >= NearW (as well as the sides of the view), so 1 / w stays finite:
+static constexpr float NearW = 1e-6f;
+
+namespace {
+
+//a function a * x + b * y + c of pixel coordinates:
+struct Plane {
+	float a, b, c;
+};
+
+} //end anonymous namespace
+
+//draw the pixels [x0,x1] of a row (whose centers have y coordinate 'y') that are inside all three edges:
+static void draw_row(float *row, uint32_t x0, uint32_t x1, float y, Plane const (&edges)[3], Plane const &z) {
+#if defined(OCCLUSION_BUFFER_SSE)
+	__m128 const offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	__m128 const zero = _mm_setzero_ps();
+	__m128 a[3], r[3];
+	for (uint32_t i = 0; i < 3; ++i) {
+		a[i] = _mm_set1_ps(edges[i].a);
+		r[i] = _mm_set1_ps(edges[i].b * y + edges[i].c);
+	}
+	__m128 za = _mm_set1_ps(z.a);
+	__m128 zr = _mm_set1_ps(z.b * y + z.c);
+	//(x0 is rounded down to a whole vector; pixels before it are outside the triangle anyway)
+	for (uint32_t x = x0 & ~3u; x <= x1; x += 4) {
+		__m128 px = _mm_add_ps(_mm_set1_ps(float(x)), offsets);
+		__m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a[0], px), r[0]), zero);
+		inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a[1], px), r[1]), zero));
+		inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a[2], px), r[2]), zero));
+		__m128 depth = _mm_and_ps(inside, _mm_add_ps(_mm_mul_ps(za, px), zr));
+		_mm_storeu_ps(row + x, _mm_max_ps(_mm_loadu_ps(row + x), depth));
+	}
+#else
+	for (uint32_t x = x0; x <= x1; ++x) {
+		float px = float(x) + 0.5f;
+		bool inside = true;
+		for (uint32_t i = 0; i < 3; ++i) {
+			inside = inside && (edges[i].a * px + edges[i].b * y + edges[i].c >= 0.0f);
+		}
+		if (inside) row[x] = std::max(row[x], z.a * px + z.b * y + z.c);
+	}
+#endif
+}
+
+//are all of the pixels [x0,x1] of a row nearer than threshold?
+static bool row_covered(float const *row, uint32_t x0, uint32_t x1, float threshold) {
+#if defined(OCCLUSION_BUFFER_SSE)
+	__m128 const lanes = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+	__m128 t = _mm_set1_ps(threshold);
+	__m128 first = _mm_set1_ps(float(x0));
+	__m128 last = _mm_set1_ps(float(x1));
+	for (uint32_t x = x0 & ~3u; x <= x1; x += 4) {
+		__m128 px = _mm_add_ps(_mm_set1_ps(float(x)), lanes);
+		__m128 in_range = _mm_and_ps(_mm_cmpge_ps(px, first), _mm_cmple_ps(px, last));
+		__m128 uncovered = _mm_and_ps(in_range, _mm_cmple_ps(_mm_loadu_ps(row + x), t));
+		if (_mm_movemask_ps(uncovered)) return false;
+	}
+	return true;
+#else
+	for (uint32_t x = x0; x <= x1; ++x) {
+		if (row[x] <= threshold) return false;
+	}
+	return true;
+#endif
+}
+
+//-------------------------
+
+void OcclusionBuffer::clear() {
+	std::fill(depth.begin(), depth.end(), 0.0f);
+	triangles = 0;
+}
+
+void OcclusionBuffer::add_box(glm::mat4 const &object_to_clip, glm::vec3 const &min, glm::vec3 const &max) {
+	if (!(min.x <= max.x && min.y <= max.y && min.z <= max.z)) return;
+
+	//corner i has x from bit 0, y from bit 1, and z from bit 2:
+	glm::vec4 corners[8];
+	for (uint32_t i = 0; i < 8; ++i) {
+		glm::vec3 corner((i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z);
+		corners[i] = object_to_clip * glm::vec4(corner, 1.0f);
+	}
+
+	//only faces that face the viewer need to be drawn (the others are behind them):
+	// the viewer is the object-space point with clip x = y = w = 0 -- unless it is at infinity (e.g., for
+	//  orthographic projections), in which case all faces are drawn
+	glm::mat3 xyw;
+	glm::vec3 offset;
+	for (uint32_t r = 0; r < 3; ++r) {
+		uint32_t row = (r == 2 ? 3 : r);
+		for (uint32_t c = 0; c < 3; ++c) xyw[c][r] = object_to_clip[c][row];
+		offset[r] = object_to_clip[3][row];
+	}
+	bool at_infinity = (std::abs(glm::determinant(xyw)) < 1e-12f);
+	glm::vec3 viewer = (at_infinity ? glm::vec3(0.0f) : -(glm::inverse(xyw) * offset));
+
+	static constexpr uint8_t Faces[6][4] = {
+		{0,2,6,4}, {1,5,7,3}, //-x, +x
+		{0,4,5,1}, {2,3,7,6}, //-y, +y
+		{0,1,3,2}, {4,6,7,5}, //-z, +z
+	};
+	for (uint32_t f = 0; f < 6; ++f) {
+		uint32_t axis = f / 2;
+		if (!at_infinity && !((f % 2) ? viewer[axis] > max[axis] : viewer[axis] < min[axis])) continue;
+		uint8_t const *face = Faces[f];
+		add_triangle(corners[face[0]], corners[face[1]], corners[face[2]]);
+		add_triangle(corners[face[0]], corners[face[2]], corners[face[3]]);
+	}
+}
+
+void OcclusionBuffer::add_triangle(glm::vec4 const &a, glm::vec4 const &b, glm::vec4 const &c) {
+	assert(depth.size() == Width * Height);
+
+	//clip to the near (w) plane and the sides of the view, one plane at a time:
+	// (each plane adds at most one vertex)
+	glm::vec4 polygon[2][8] = {{a, b, c}};
+	uint32_t count = 3;
+	uint32_t from = 0;
+	//planes are w + sign * coord >= offset:
+	static constexpr struct { uint32_t coord; float sign; float offset; } Planes[5] = {
+		{0, 0.0f, NearW},
+		{0, 1.0f, 0.0f}, {0,-1.0f, 0.0f},
+		{1, 1.0f, 0.0f}, {1,-1.0f, 0.0f},
+	};
+	for (auto const &plane : Planes) {
+		auto distance = [&](glm::vec4 const &v) { return v.w + plane.sign * v[plane.coord] - plane.offset; };
+		glm::vec4 const *in = polygon[from];
+		glm::vec4 *out = polygon[1 - from];
+		uint32_t out_count = 0;
+		for (uint32_t i = 0; i < count; ++i) {
+			glm::vec4 const &v0 = in[i];
+			glm::vec4 const &v1 = in[(i + 1) % count];
+			float d0 = distance(v0);
+			float d1 = distance(v1);
+			if (d0 >= 0.0f) out[out_count++] = v0;
+			if ((d0 >= 0.0f) != (d1 >= 0.0f)) out[out_count++] = glm::mix(v0, v1, d0 / (d0 - d1));
+		}
+		count = out_count;
+		from = 1 - from;
+		if (count < 3) return;
+	}
+
+	//to pixel coordinates (x, y) and 1 / w (z):
+	glm::vec3 points[8];
+	for (uint32_t i = 0; i < count; ++i) {
+		glm::vec4 const &v = polygon[from][i];
+		float inv_w = 1.0f / v.w;
+		points[i] = glm::vec3(
+			(v.x * inv_w * 0.5f + 0.5f) * float(Width),
+			(v.y * inv_w * 0.5f + 0.5f) * float(Height),
+			inv_w
+		);
+	}
+
+	//draw the clipped polygon as a fan:
+	for (uint32_t i = 2; i < count; ++i) {
+		glm::vec3 p[3] = {points[0], points[i-1], points[i]};
+		float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+		if (area < 0.0f) {
+			std::swap(p[1], p[2]);
+			area = -area;
+		}
+		if (!(area > 1e-8f)) continue; //(degenerate, or seen edge-on)
+
+		//edges[i] is positive to the inside of the edge opposite p[i]:
+		Plane edges[3];
+		for (uint32_t e = 0; e < 3; ++e) {
+			glm::vec3 const &pa = p[(e + 1) % 3];
+			glm::vec3 const &pb = p[(e + 2) % 3];
+			edges[e].a = -(pb.y - pa.y);
+			edges[e].b = pb.x - pa.x;
+			edges[e].c = -edges[e].a * pa.x - edges[e].b * pa.y;
+		}
+		//1 / w, from barycentric weights edges[i] / area:
+		Plane z;
+		z.a = (edges[0].a * p[0].z + edges[1].a * p[1].z + edges[2].a * p[2].z) / area;
+		z.b = (edges[0].b * p[0].z + edges[1].b * p[1].z + edges[2].b * p[2].z) / area;
+		z.c = (edges[0].c * p[0].z + edges[1].c * p[1].z + edges[2].c * p[2].z) / area;
+
+		//pixels whose centers might be inside:
+		float min_x = std::min(std::min(p[0].x, p[1].x), p[2].x);
+		float max_x = std::max(std::max(p[0].x, p[1].x), p[2].x);
+		float min_y = std::min(std::min(p[0].y, p[1].y), p[2].y);
+		float max_y = std::max(std::max(p[0].y, p[1].y), p[2].y);
+		int32_t x0 = std::max(0, int32_t(std::ceil(min_x - 0.5f)));
+		int32_t x1 = std::min(int32_t(Width) - 1, int32_t(std::floor(max_x - 0.5f)));
+		int32_t y0 = std::max(0, int32_t(std::ceil(min_y - 0.5f)));
+		int32_t y1 = std::min(int32_t(Height) - 1, int32_t(std::floor(max_y - 0.5f)));
+		if (x0 > x1 || y0 > y1) continue;
+
+		for (int32_t y = y0; y <= y1; ++y) {
+			draw_row(&depth[y * Width], uint32_t(x0), uint32_t(x1), float(y) + 0.5f, edges, z);
+		}
+		triangles += 1;
+	}
+}
+
+bool OcclusionBuffer::occluded(glm::mat4 const &object_to_clip, glm::vec3 const &min, glm::vec3 const &max) const {
+	assert(depth.size() == Width * Height);
+
+	//screen-space rectangle and nearest w of the box:
+	glm::vec2 rect_min(std::numeric_limits< float >::infinity());
+	glm::vec2 rect_max(-std::numeric_limits< float >::infinity());
+	float min_w = std::numeric_limits< float >::infinity();
+	for (uint32_t i = 0; i < 8; ++i) {
+		glm::vec3 corner((i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z);
+		glm::vec4 v = object_to_clip * glm::vec4(corner, 1.0f);
+		if (!(v.w >= NearW)) return false; //box reaches the viewer
+		glm::vec2 ndc = glm::vec2(v) / v.w;
+		rect_min = glm::min(rect_min, ndc);
+		rect_max = glm::max(rect_max, ndc);
+		min_w = std::min(min_w, v.w);
+	}
+
+	//every pixel the (on-screen part of the) rectangle touches:
+	rect_min = glm::max(rect_min, glm::vec2(-1.0f));
+	rect_max = glm::min(rect_max, glm::vec2(1.0f));
+	if (!(rect_min.x <= rect_max.x && rect_min.y <= rect_max.y)) return false; //(off screen -- so it's up to frustum culling)
+	int32_t x0 = std::max(0, int32_t(std::floor((rect_min.x * 0.5f + 0.5f) * float(Width))));
+	int32_t x1 = std::min(int32_t(Width) - 1, int32_t(std::ceil((rect_max.x * 0.5f + 0.5f) * float(Width))) - 1);
+	int32_t y0 = std::max(0, int32_t(std::floor((rect_min.y * 0.5f + 0.5f) * float(Height))));
+	int32_t y1 = std::min(int32_t(Height) - 1, int32_t(std::ceil((rect_max.y * 0.5f + 0.5f) * float(Height))) - 1);
+	if (x0 > x1 || y0 > y1) return false;
+
+	float threshold = (1.0f / min_w) * (1.0f + DepthBias);
+	for (int32_t y = y0; y <= y1; ++y) {
+		if (!row_covered(&depth[y * Width], uint32_t(x0), uint32_t(x1), threshold)) return false;
+	}
+	return true;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+/*
+ * OcclusionBuffer is a small CPU depth buffer for occlusion culling.
+ *
+ * Big, solid objects ("occluders") are drawn into it as boxes, then other
+ *  objects' bounding boxes are tested against it: a box is occluded if every
+ *  pixel its screen-space rectangle touches is covered by an occluder that is
+ *  nearer than the box's nearest point.
+ *
+ * The buffer covers normalized device x,y in [-1,1] with Width x Height pixels
+ *  and stores 1 / (clip-space w) -- which is linear in screen space, so it can
+ *  be interpolated across triangles, and works with infinite projections -- with
+ *  0 meaning "nothing drawn here".
+ *
+ * Rows are drawn and tested four pixels at a time with SSE (when available).
+ *
+ * Usage:
+ *  OcclusionBuffer buffer;
+ *  buffer.clear();
+ *  buffer.add_box(world_to_clip * glm::mat4(wall_to_world), wall_min, wall_max); //occluders
+ *  if (buffer.occluded(world_to_clip * glm::mat4(thing_to_world), thing_min, thing_max)) //..skip thing
+ *
+ */
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct OcclusionBuffer {
+	enum : uint32_t {
+		Width = 256, //(a multiple of four, so rows are whole vectors)
+		Height = 144,
+	};
+	//boxes only count as occluded if they are this fraction further away than the occluders in front of them:
+	// (so an occluder doesn't hide itself, and coplanar surfaces don't hide each other)
+	static constexpr float DepthBias = 1e-3f;
+
+	//forget all occluders:
+	void clear();
+
+	//draw the (solid) box [min,max] as an occluder:
+	// (only its faces that face the viewer are drawn -- so none are if the viewer is inside it)
+	void add_box(glm::mat4 const &object_to_clip, glm::vec3 const &min, glm::vec3 const &max);
+	//draw a triangle (given in clip space) as part of an occluder:
+	void add_triangle(glm::vec4 const &a, glm::vec4 const &b, glm::vec4 const &c);
+
+	//is the box [min,max] hidden behind occluders?
+	// (boxes that cross the w = 0 plane are never occluded)
+	bool occluded(glm::mat4 const &object_to_clip, glm::vec3 const &min, glm::vec3 const &max) const;
+
+	//--- results ---
+
+	//per pixel, 1 / w of the nearest occluder (0 if none), row by row from the bottom of the view:
+	std::vector< float > depth = std::vector< float >(Width * Height, 0.0f);
+	uint32_t triangles = 0; //triangles drawn since clear() (after clipping)
+};
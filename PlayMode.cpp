@@ -32,6 +32,30 @@ Load< Scene > hexapod_scene(LoadTagDefault, []() -> Scene const * {
 		drawable.pipeline.type = mesh.type;
 		drawable.pipeline.start = mesh.start;
 		drawable.pipeline.count = mesh.count;
+		drawable.pipeline.index_type = mesh.index_type;
+		drawable.pipeline.base_vertex = mesh.base_vertex;
+
+		drawable.min = mesh.min;
+		drawable.max = mesh.max;
+
+		//use simpler meshes (if the buffer has any) as the drawable gets smaller on screen:
+		std::vector< Mesh const * > lods = hexapod_meshes->lookup_lods(mesh_name);
+		float screen_size = 0.2f;
+		for (uint32_t i = 0; i < lods.size() && i < Scene::Drawable::LODCount; ++i) {
+			drawable.lods[i].type = lods[i]->type;
+			drawable.lods[i].start = lods[i]->start;
+			drawable.lods[i].count = lods[i]->count;
+			drawable.lods[i].base_vertex = lods[i]->base_vertex;
+			drawable.lods[i].screen_size = screen_size;
+			screen_size *= 0.5f;
+		}
+
+		//hide things behind the drawable if the buffer has a "name.Occluder" mesh (whose bounds the mesh entirely covers):
+		auto occluder = hexapod_meshes->meshes.find(mesh_name + ".Occluder");
+		if (occluder != hexapod_meshes->meshes.end()) {
+			drawable.occluder_min = occluder->second.min;
+			drawable.occluder_max = occluder->second.max;
+		}
 
 	});
 });
@@ -42,18 +66,38 @@ Load< Sound::Sample > dusty_floor_sample(LoadTagDefault, []() -> Sound::Sample c
 
 PlayMode::PlayMode() : scene(*hexapod_scene) {
 	//get pointers to leg for convenience:
-	for (auto &transform : scene.transforms) {
-		if (transform.name == "Hip.FL") hip = &transform;
-		else if (transform.name == "UpperLeg.FL") upper_leg = &transform;
-		else if (transform.name == "LowerLeg.FL") lower_leg = &transform;
-	}
+	hip = scene.find_transform("Hip.FL");
+	upper_leg = scene.find_transform("UpperLeg.FL");
+	lower_leg = scene.find_transform("LowerLeg.FL");
 	if (hip == nullptr) throw std::runtime_error("Hip not found.");
 	if (upper_leg == nullptr) throw std::runtime_error("Upper leg not found.");
 	if (lower_leg == nullptr) throw std::runtime_error("Lower leg not found.");
 
-	hip_base_rotation = hip->rotation;
-	upper_leg_base_rotation = upper_leg->rotation;
-	lower_leg_base_rotation = lower_leg->rotation;
+	//if the scene file has no animation, make tracks that wobble the leg:
+	if (scene.tracks.empty()) {
+		auto add_wobble = [this](Scene::Transform *transform, float degrees, float cycles, glm::vec3 const &axis) {
+			Scene::Track track;
+			track.transform = transform;
+			track.channel = Scene::Track::Rotation;
+			track.key_begin = uint32_t(scene.key_times.size());
+			//(one key every tenth of a second over a ten-second loop)
+			for (uint32_t i = 0; i <= 100; ++i) {
+				float wobble = i / 100.0f;
+				glm::quat rotation = transform->rotation * glm::angleAxis(
+					glm::radians(degrees * std::sin(wobble * cycles * 2.0f * float(M_PI))),
+					axis
+				);
+				scene.key_times.emplace_back(10.0f * wobble);
+				scene.key_values.emplace_back(rotation.x, rotation.y, rotation.z, rotation.w);
+			}
+			track.key_end = uint32_t(scene.key_times.size());
+			scene.tracks.emplace_back(track);
+		};
+		add_wobble(hip, 5.0f, 1.0f, glm::vec3(0.0f, 1.0f, 0.0f));
+		add_wobble(upper_leg, 7.0f, 2.0f, glm::vec3(0.0f, 0.0f, 1.0f));
+		add_wobble(lower_leg, 10.0f, 3.0f, glm::vec3(0.0f, 0.0f, 1.0f));
+	}
+	animation.build(scene);
 
 	//get pointer to camera for convenience:
 	if (scene.cameras.size() != 1) throw std::runtime_error("Expecting scene to have exactly one camera, but it has " + std::to_string(scene.cameras.size()));
@@ -279,6 +323,8 @@ PlayMode::PlayMode() : scene(*hexapod_scene) {
 }
 
 PlayMode::~PlayMode() {
+	//(modes are destroyed while the GL context is still current)
+	scene.release_buffers();
 }
 
 bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size) {
@@ -329,11 +375,11 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 				evt.motion.xrel / float(window_size.y),
 				-evt.motion.yrel / float(window_size.y)
 			);
-			camera->transform->rotation = glm::normalize(
+			camera->transform->set_rotation(glm::normalize(
 				camera->transform->rotation
 				* glm::angleAxis(-motion.x * camera->fovy, glm::vec3(0.0f, 1.0f, 0.0f))
 				* glm::angleAxis(motion.y * camera->fovy, glm::vec3(1.0f, 0.0f, 0.0f))
-			);
+			));
 			return true;
 		}
 	}
@@ -343,22 +389,10 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 
 void PlayMode::update(float elapsed) {
 
-	//slowly rotates through [0,1):
-	wobble += elapsed / 10.0f;
-	wobble -= std::floor(wobble);
-
-	hip->rotation = hip_base_rotation * glm::angleAxis(
-		glm::radians(5.0f * std::sin(wobble * 2.0f * float(M_PI))),
-		glm::vec3(0.0f, 1.0f, 0.0f)
-	);
-	upper_leg->rotation = upper_leg_base_rotation * glm::angleAxis(
-		glm::radians(7.0f * std::sin(wobble * 2.0f * 2.0f * float(M_PI))),
-		glm::vec3(0.0f, 0.0f, 1.0f)
-	);
-	lower_leg->rotation = lower_leg_base_rotation * glm::angleAxis(
-		glm::radians(10.0f * std::sin(wobble * 3.0f * 2.0f * float(M_PI))),
-		glm::vec3(0.0f, 0.0f, 1.0f)
-	);
+	//play the animation (keeping time within the loop, so it doesn't lose precision):
+	animation_time += elapsed;
+	if (animation.duration > 0.0f) animation_time = std::fmod(animation_time, animation.duration);
+	animation.sample(animation_time);
 
 	//move sound to follow leg tip position:
 	leg_tip_loop->set_position(get_leg_tip_position(), 1.0f / 60.0f);
@@ -382,7 +416,17 @@ void PlayMode::update(float elapsed) {
 		//glm::vec3 up = frame[1];
 		glm::vec3 forward = -frame[2];
 
-		camera->transform->position += move.x * right + move.y * forward;
+		glm::vec3 step = move.x * right + move.y * forward;
+
+		//don't walk through things -- stop a little short of the first drawable along the step:
+		if (step != glm::vec3(0.0f)) {
+			constexpr float CameraRadius = 1.0f;
+			glm::mat4x3 parent_to_world = (camera->transform->parent ? camera->transform->parent->make_local_to_world() : glm::mat4x3(1.0f));
+			glm::vec3 world_step = parent_to_world * glm::vec4(step, 0.0f);
+			step *= scene.step_fraction(camera->transform->make_local_to_world()[3], world_step, CameraRadius);
+		}
+
+		camera->transform->set_position(camera->transform->position + step);
 	}
 
 	{ //update listener to camera position:
@@ -403,13 +447,11 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 	//update camera aspect ratio for drawable:
 	// camera->aspect = float(drawable_size.x) / float(drawable_size.y);
 
-	// //set up light type and position for lit_color_texture_program:
-	// // TODO: consider using the Light(s) in the scene to do this
-	// glUseProgram(lit_color_texture_program->program);
-	// glUniform1i(lit_color_texture_program->LIGHT_TYPE_int, 1);
-	// glUniform3fv(lit_color_texture_program->LIGHT_DIRECTION_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 0.0f,-1.0f)));
-	// glUniform3fv(lit_color_texture_program->LIGHT_ENERGY_vec3, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 0.95f)));
-	// glUseProgram(0);
+	// //lit_color_texture_program is lit by scene.lights (Scene::draw bins them into clusters for the shader),
+	// // so a scene without lights draws black -- e.g., add a hemisphere light in the constructor:
+	// //  Scene::Light &sky = scene.lights.emplace_back(&scene.transforms.emplace_back());
+	// //  sky.type = Scene::Light::Hemisphere;
+	// //  sky.energy = glm::vec3(1.0f, 1.0f, 0.95f);
 
 	// glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
 	// glClearDepth(1.0f); //1.0 is actually the default value to clear the depth buffer to, but FYI you can change it.
@@ -1,6 +1,7 @@
 #include "Mode.hpp"
 
 #include "Scene.hpp"
+#include "AnimationSampler.hpp"
 #include "Sound.hpp"
 #include "DrawText.hpp"
 #include "ColorTextureProgram.hpp"
@@ -47,10 +48,9 @@ struct PlayMode : Mode {
 	Scene::Transform *hip = nullptr;
 	Scene::Transform *upper_leg = nullptr;
 	Scene::Transform *lower_leg = nullptr;
-	glm::quat hip_base_rotation;
-	glm::quat upper_leg_base_rotation;
-	glm::quat lower_leg_base_rotation;
-	float wobble = 0.0f;
+	//keyframe animation (the scene's own tracks, or a wobble made for the leg):
+	AnimationSampler animation;
+	float animation_time = 0.0f;
 
 	glm::vec3 get_leg_tip_position();
 
@@ -0,0 +1,308 @@
+#pragma once
+
+/*
+ * A Pool< T > stores objects in fixed-size chunks, so that:
+ *  - objects never move once created (pointers to them stay valid until they are erased),
+ *  - adding an object only allocates when a chunk fills up,
+ *  - iteration walks contiguous memory, like a vector.
+ *
+ * Objects can also be referred to by generation-checked Handles:
+ *  get(handle) returns nullptr once the object it referred to has been erased,
+ *  even if its slot has since been reused.
+ *
+ * Usage is list-like:
+ *  pool.emplace_back(args...); //always adds at the end, so pool.back() is the new object
+ *  for (auto &obj : pool) { ... }
+ *
+ * Copying a pool copies its objects into the same slots, so slot indices from the original
+ *  refer to the corresponding objects in the copy. Handles from the original also work in a
+ *  copy-constructed (or move-constructed) pool. Assigning into an existing pool invalidates
+ *  every handle to its old objects; since slot generations must then move past the old
+ *  values, handles from the source aren't guaranteed to work in the destination.
+ *
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+template< typename T, uint32_t ChunkSize = 64 >
+struct Pool {
+	static_assert(ChunkSize > 0 && (ChunkSize & (ChunkSize - 1)) == 0, "ChunkSize should be a power of two.");
+
+	struct Handle {
+		uint32_t index = -1U;
+		uint32_t generation = 0; //odd generations are alive; 0 never refers to anything
+		bool operator==(Handle const &o) const { return index == o.index && generation == o.generation; }
+		bool operator!=(Handle const &o) const { return !(*this == o); }
+	};
+
+	Pool() = default;
+	Pool(Pool const &other) { *this = other; }
+	Pool(Pool &&other) { swap(other); }
+	Pool &operator=(Pool const &other);
+	Pool &operator=(Pool &&other);
+	~Pool() { clear(); }
+
+	//add an object at the end of the pool:
+	template< typename... Args >
+	T &emplace_back(Args&&... args);
+
+	//add an object, re-using the slot of an erased object if there is one:
+	template< typename... Args >
+	T &emplace(Args&&... args);
+
+	//remove an object (its slot may be re-used by emplace):
+	void erase(T const *obj);
+	void erase(Handle const &handle);
+
+	//remove all objects (keeps allocated chunks for re-use):
+	void clear();
+
+	//make sure there are at least 'count' slots allocated:
+	void reserve(uint32_t count);
+
+	uint32_t size() const { return alive; }
+	bool empty() const { return alive == 0; }
+
+	//changes whenever objects are added or removed (handy for noticing when derived data is stale):
+	uint32_t revision() const { return revisions; }
+
+	//first and last objects in the pool:
+	T &front() { return *begin(); }
+	T const &front() const { return *begin(); }
+	T &back();
+	T const &back() const { return const_cast< Pool * >(this)->back(); }
+
+	//handle lookup:
+	Handle handle(T const *obj) const; //returns an invalid Handle if obj isn't in this pool
+	T *get(Handle const &handle);
+	T const *get(Handle const &handle) const { return const_cast< Pool * >(this)->get(handle); }
+
+	//slot indices (stable for the life of each object; preserved when copying a pool):
+	uint32_t index(T const *obj) const; //returns -1U if obj isn't in this pool (O(log chunks))
+	T &at_index(uint32_t index) { assert(occupied(index)); return *slot(index); }
+	T const &at_index(uint32_t index) const { return const_cast< Pool * >(this)->at_index(index); }
+	uint32_t slots() const { return used; } //one more than the largest index ever used
+	bool occupied(uint32_t index) const { return index < used && (generations[index] & 1); } //does slot 'index' hold an object?
+
+	//iteration (visits objects in slot order):
+	template< typename P, typename V >
+	struct Iterator {
+		P *pool = nullptr;
+		uint32_t index = 0;
+		V &operator*() const { return *pool->slot(index); }
+		V *operator->() const { return pool->slot(index); }
+		Iterator &operator++() {
+			do { ++index; } while (index < pool->used && !(pool->generations[index] & 1));
+			return *this;
+		}
+		bool operator==(Iterator const &o) const { return index == o.index; }
+		bool operator!=(Iterator const &o) const { return index != o.index; }
+	};
+	typedef Iterator< Pool, T > iterator;
+	typedef Iterator< Pool const, T const > const_iterator;
+
+	iterator begin() { return iterator{this, first_alive()}; }
+	iterator end() { return iterator{this, used}; }
+	const_iterator begin() const { return const_iterator{this, first_alive()}; }
+	const_iterator end() const { return const_iterator{this, used}; }
+
+	//--- internals ---
+	struct Chunk {
+		alignas(T) unsigned char storage[sizeof(T) * ChunkSize];
+	};
+	std::vector< std::unique_ptr< Chunk > > chunks;
+	std::vector< std::pair< T const *, uint32_t > > chunks_by_address; //(first slot, chunk index), sorted -- lets index() binary search
+	std::vector< uint32_t > generations; //per slot in [0,used); odd means the slot holds an object
+	std::vector< uint32_t > free_slots; //erased slots below 'used'
+	uint32_t used = 0;
+	uint32_t alive = 0;
+	uint32_t revisions = 0;
+
+	T *slot(uint32_t i) const {
+		return reinterpret_cast< T * >(chunks[i / ChunkSize]->storage) + (i % ChunkSize);
+	}
+	uint32_t first_alive() const {
+		uint32_t i = 0;
+		while (i < used && !(generations[i] & 1)) ++i;
+		return i;
+	}
+	void allocate_chunks(uint32_t count); //make sure slots [0,count) have storage
+	template< typename... Args >
+	T &construct(uint32_t i, Args&&... args) {
+		T *obj = new (slot(i)) T(std::forward< Args >(args)...);
+		generations[i] += 1;
+		alive += 1;
+		revisions += 1;
+		return *obj;
+	}
+	//generation for a slot taking on 'incoming' after holding 'retired' (even, from clear()):
+	// newer than 'retired', so no old handle validates, with the parity (alive or not) of 'incoming':
+	static uint32_t newer_generation(uint32_t retired, uint32_t incoming) {
+		if (incoming >= retired) return incoming;
+		uint32_t g = retired + 1;
+		if ((g ^ incoming) & 1) g += 1;
+		return g;
+	}
+	//after clear() and taking on another pool's generations, move them past 'retired':
+	void retire_generations(std::vector< uint32_t > const &retired) {
+		if (generations.size() < retired.size()) generations.resize(retired.size(), 0);
+		for (uint32_t i = 0; i < retired.size(); ++i) {
+			generations[i] = newer_generation(retired[i], generations[i]);
+		}
+	}
+	void swap(Pool &other) {
+		std::swap(chunks, other.chunks);
+		std::swap(chunks_by_address, other.chunks_by_address);
+		std::swap(generations, other.generations);
+		std::swap(free_slots, other.free_slots);
+		std::swap(used, other.used);
+		std::swap(alive, other.alive);
+		//(both pools now hold different objects than before)
+		revisions += 1;
+		other.revisions += 1;
+	}
+};
+
+//------------------------
+
+template< typename T, uint32_t ChunkSize >
+Pool< T, ChunkSize > &Pool< T, ChunkSize >::operator=(Pool const &other) {
+	if (&other == this) return *this;
+	clear();
+	reserve(other.used);
+	for (uint32_t i = 0; i < other.used; ++i) {
+		if (other.generations[i] & 1) {
+			new (slot(i)) T(*other.slot(i));
+		}
+	}
+	std::vector< uint32_t > retired = std::move(generations);
+	generations = other.generations;
+	retire_generations(retired);
+	free_slots = other.free_slots;
+	used = other.used;
+	alive = other.alive;
+	revisions += 1;
+	return *this;
+}
+
+template< typename T, uint32_t ChunkSize >
+Pool< T, ChunkSize > &Pool< T, ChunkSize >::operator=(Pool &&other) {
+	if (&other == this) return *this;
+	clear();
+	std::vector< uint32_t > retired = generations;
+	swap(other);
+	retire_generations(retired);
+	return *this;
+}
+
+template< typename T, uint32_t ChunkSize >
+template< typename... Args >
+T &Pool< T, ChunkSize >::emplace_back(Args&&... args) {
+	allocate_chunks(used + 1);
+	if (generations.size() < used + 1) generations.resize(used + 1, 0);
+	used += 1;
+	return construct(used - 1, std::forward< Args >(args)...);
+}
+
+template< typename T, uint32_t ChunkSize >
+template< typename... Args >
+T &Pool< T, ChunkSize >::emplace(Args&&... args) {
+	if (free_slots.empty()) return emplace_back(std::forward< Args >(args)...);
+	uint32_t i = free_slots.back();
+	free_slots.pop_back();
+	return construct(i, std::forward< Args >(args)...);
+}
+
+template< typename T, uint32_t ChunkSize >
+void Pool< T, ChunkSize >::erase(T const *obj) {
+	uint32_t i = index(obj);
+	assert(i != -1U && "object should be in this pool");
+	slot(i)->~T();
+	generations[i] += 1;
+	alive -= 1;
+	revisions += 1;
+	free_slots.emplace_back(i);
+}
+
+template< typename T, uint32_t ChunkSize >
+void Pool< T, ChunkSize >::erase(Handle const &handle) {
+	T *obj = get(handle);
+	if (obj) erase(obj);
+}
+
+template< typename T, uint32_t ChunkSize >
+void Pool< T, ChunkSize >::clear() {
+	for (uint32_t i = 0; i < used; ++i) {
+		if (generations[i] & 1) {
+			slot(i)->~T();
+			generations[i] += 1; //invalidates old handles
+		}
+	}
+	free_slots.clear();
+	used = 0;
+	alive = 0;
+	revisions += 1;
+}
+
+template< typename T, uint32_t ChunkSize >
+void Pool< T, ChunkSize >::reserve(uint32_t count) {
+	allocate_chunks(count);
+	generations.reserve(count);
+}
+
+template< typename T, uint32_t ChunkSize >
+void Pool< T, ChunkSize >::allocate_chunks(uint32_t count) {
+	while (chunks.size() * ChunkSize < count) {
+		chunks.emplace_back(new Chunk);
+		std::pair< T const *, uint32_t > entry(reinterpret_cast< T const * >(chunks.back()->storage), uint32_t(chunks.size() - 1));
+		chunks_by_address.insert(std::upper_bound(chunks_by_address.begin(), chunks_by_address.end(), entry,
+			[](std::pair< T const *, uint32_t > const &a, std::pair< T const *, uint32_t > const &b) { return std::less< T const * >()(a.first, b.first); }
+		), entry);
+	}
+}
+
+template< typename T, uint32_t ChunkSize >
+T &Pool< T, ChunkSize >::back() {
+	assert(alive > 0 && "back() called on empty pool");
+	uint32_t i = used - 1;
+	while (!(generations[i] & 1)) --i;
+	return *slot(i);
+}
+
+template< typename T, uint32_t ChunkSize >
+uint32_t Pool< T, ChunkSize >::index(T const *obj) const {
+	//find the last chunk starting at or before obj:
+	auto f = std::upper_bound(chunks_by_address.begin(), chunks_by_address.end(), obj,
+		[](T const *o, std::pair< T const *, uint32_t > const &c) { return std::less< T const * >()(o, c.first); }
+	);
+	if (f == chunks_by_address.begin()) return -1U;
+	--f;
+	if (!std::less< T const * >()(obj, f->first + ChunkSize)) return -1U;
+	uint32_t i = f->second * ChunkSize + uint32_t(obj - f->first);
+	if (i < used && (generations[i] & 1)) return i;
+	return -1U;
+}
+
+template< typename T, uint32_t ChunkSize >
+typename Pool< T, ChunkSize >::Handle Pool< T, ChunkSize >::handle(T const *obj) const {
+	Handle ret;
+	uint32_t i = index(obj);
+	if (i != -1U) {
+		ret.index = i;
+		ret.generation = generations[i];
+	}
+	return ret;
+}
+
+template< typename T, uint32_t ChunkSize >
+T *Pool< T, ChunkSize >::get(Handle const &handle) {
+	if (handle.index >= used || generations[handle.index] != handle.generation || !(handle.generation & 1)) return nullptr;
+	return slot(handle.index);
+}
@@ -1,15 +1,30 @@
 #include "Scene.hpp"
 
 #include "gl_errors.hpp"
-#include "read_write_chunk.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
-#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <type_traits>
+
+#if defined(__AVX__)
+	#include <immintrin.h>
+	#define SCENE_TRANSFORM_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define SCENE_TRANSFORM_SSE
+#endif
 
 //-------------------------
 
 glm::mat4x3 Scene::Transform::make_local_to_parent() const {
+	return make_local_to_parent(position, rotation, scale);
+}
+
+glm::mat4x3 Scene::Transform::make_local_to_parent(glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale) {
 	//compute:
 	//   translate   *   rotate    *   scale
 	// [ 1 0 0 p.x ]   [       0 ]   [ s.x 0 0 0 ]
@@ -57,20 +72,404 @@ glm::mat4x3 Scene::Transform::make_parent_to_local() const {
 }
 
 glm::mat4x3 Scene::Transform::make_local_to_world() const {
-	if (!parent) {
-		return make_local_to_parent();
-	} else {
-		return parent->make_local_to_world() * glm::mat4(make_local_to_parent()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+	if (local_to_world_dirty) {
+		if (!parent) {
+			local_to_world = make_local_to_parent();
+		} else {
+			local_to_world = parent->make_local_to_world() * glm::mat4(make_local_to_parent()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+		}
+		local_to_world_dirty = false;
+		local_to_world_revision += 1;
 	}
+	return local_to_world;
 }
 glm::mat4x3 Scene::Transform::make_world_to_local() const {
-	if (!parent) {
-		return make_parent_to_local();
-	} else {
-		return make_parent_to_local() * glm::mat4(parent->make_world_to_local()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+	if (world_to_local_dirty) {
+		if (!parent) {
+			world_to_local = make_parent_to_local();
+		} else {
+			world_to_local = make_parent_to_local() * glm::mat4(parent->make_world_to_local()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+		}
+		world_to_local_dirty = false;
+	}
+	return world_to_local;
+}
+
+//-------------------------
+//Batched kernel:
+// (used by Transform::update_local_to_world, and by TransformHierarchy via Transform::compute_local_to_world)
+// Transforms are copied into a structure-of-arrays 'Batch' (one lane per transform),
+// the kernel computes every lane with vector instructions, and results are copied back.
+//
+// The kernel uses the same operations, in the same order, as glm::mat3_cast and
+// glm's mat4x3 * mat4 (including the multiply by the padded (0,0,0,1) row), so
+// results match the per-transform path exactly as long as the compiler doesn't
+// contract the scalar path into fused multiply-adds (it doesn't on x86 without -mfma).
+
+namespace {
+
+constexpr uint32_t BatchWidth = Scene::Transform::KernelWidth;
+
+struct Batch {
+	alignas(32) float position[3][BatchWidth];
+	alignas(32) float rotation[4][BatchWidth]; //x,y,z,w
+	alignas(32) float scale[3][BatchWidth];
+	alignas(32) float parent[12][BatchWidth]; //parent's local_to_world, column-major
+	alignas(32) uint32_t is_root[BatchWidth]; //all bits set for roots
+	alignas(32) float world[12][BatchWidth]; //result, column-major
+};
+
+//Thin wrappers so the kernel can be written once for any lane width:
+
+struct Scalar {
+	static constexpr uint32_t Width = 1;
+	float v;
+	Scalar() = default;
+	explicit Scalar(float v_) : v(v_) { }
+	static Scalar load(float const *from) { return Scalar(*from); }
+	void store(float *to) const { *to = v; }
+	static Scalar select(uint32_t const *mask, Scalar a, Scalar b) { return *mask ? a : b; }
+};
+inline Scalar operator+(Scalar a, Scalar b) { return Scalar(a.v + b.v); }
+inline Scalar operator-(Scalar a, Scalar b) { return Scalar(a.v - b.v); }
+inline Scalar operator*(Scalar a, Scalar b) { return Scalar(a.v * b.v); }
+
+#if defined(SCENE_TRANSFORM_SSE)
+struct SSE {
+	static constexpr uint32_t Width = 4;
+	__m128 v;
+	SSE() = default;
+	SSE(__m128 v_) : v(v_) { }
+	explicit SSE(float f) : v(_mm_set1_ps(f)) { }
+	static SSE load(float const *from) { return _mm_load_ps(from); }
+	void store(float *to) const { _mm_store_ps(to, v); }
+	static SSE select(uint32_t const *mask, SSE a, SSE b) {
+		__m128 m = _mm_castsi128_ps(_mm_load_si128(reinterpret_cast< __m128i const * >(mask)));
+		return _mm_or_ps(_mm_and_ps(m, a.v), _mm_andnot_ps(m, b.v));
+	}
+};
+inline SSE operator+(SSE a, SSE b) { return _mm_add_ps(a.v, b.v); }
+inline SSE operator-(SSE a, SSE b) { return _mm_sub_ps(a.v, b.v); }
+inline SSE operator*(SSE a, SSE b) { return _mm_mul_ps(a.v, b.v); }
+typedef SSE Lanes;
+#elif defined(SCENE_TRANSFORM_AVX)
+struct AVX {
+	static constexpr uint32_t Width = 8;
+	__m256 v;
+	AVX() = default;
+	AVX(__m256 v_) : v(v_) { }
+	explicit AVX(float f) : v(_mm256_set1_ps(f)) { }
+	static AVX load(float const *from) { return _mm256_load_ps(from); }
+	void store(float *to) const { _mm256_store_ps(to, v); }
+	static AVX select(uint32_t const *mask, AVX a, AVX b) {
+		__m256 m = _mm256_load_ps(reinterpret_cast< float const * >(mask));
+		return _mm256_blendv_ps(b.v, a.v, m);
+	}
+};
+inline AVX operator+(AVX a, AVX b) { return _mm256_add_ps(a.v, b.v); }
+inline AVX operator-(AVX a, AVX b) { return _mm256_sub_ps(a.v, b.v); }
+inline AVX operator*(AVX a, AVX b) { return _mm256_mul_ps(a.v, b.v); }
+typedef AVX Lanes;
+#else
+typedef Scalar Lanes;
+#endif
+
+static_assert(BatchWidth % Lanes::Width == 0, "batch is a whole number of vectors");
+
+template< typename V >
+void compute_batch(Batch &b) {
+	V const zero(0.0f), one(1.0f), two(2.0f);
+	for (uint32_t o = 0; o < BatchWidth; o += V::Width) {
+		V x = V::load(&b.rotation[0][o]);
+		V y = V::load(&b.rotation[1][o]);
+		V z = V::load(&b.rotation[2][o]);
+		V w = V::load(&b.rotation[3][o]);
+
+		//rotation matrix, as in glm::mat3_cast:
+		V qxx = x * x, qyy = y * y, qzz = z * z;
+		V qxz = x * z, qxy = x * y, qyz = y * z;
+		V qwx = w * x, qwy = w * y, qwz = w * z;
+		V rot[3][3] = {
+			{ one - two * (qyy + qzz), two * (qxy + qwz), two * (qxz - qwy) },
+			{ two * (qxy - qwz), one - two * (qxx + qzz), two * (qyz + qwx) },
+			{ two * (qxz + qwy), two * (qyz - qwx), one - two * (qxx + qyy) },
+		};
+
+		//local_to_parent, as in Scene::Transform::make_local_to_parent:
+		V local[4][3];
+		for (uint32_t c = 0; c < 3; ++c) {
+			V s = V::load(&b.scale[c][o]);
+			for (uint32_t r = 0; r < 3; ++r) {
+				local[c][r] = rot[c][r] * s;
+			}
+		}
+		for (uint32_t r = 0; r < 3; ++r) {
+			local[3][r] = V::load(&b.position[r][o]);
+		}
+
+		//local_to_world = parent * mat4(local_to_parent), or just local_to_parent for roots:
+		V parent[4][3];
+		for (uint32_t c = 0; c < 4; ++c) {
+			for (uint32_t r = 0; r < 3; ++r) {
+				parent[c][r] = V::load(&b.parent[c*3+r][o]);
+			}
+		}
+		for (uint32_t c = 0; c < 4; ++c) {
+			V pad = (c == 3 ? one : zero); //bottom row of mat4(local_to_parent)
+			for (uint32_t r = 0; r < 3; ++r) {
+				V world = parent[0][r] * local[c][0] + parent[1][r] * local[c][1] + parent[2][r] * local[c][2] + parent[3][r] * pad;
+				V::select(&b.is_root[o], local[c][r], world).store(&b.world[c*3+r][o]);
+			}
+		}
+	}
+}
+
+} //end anonymous namespace
+
+void Scene::Transform::compute_local_to_world(uint32_t count, glm::vec3 const *positions, glm::quat const *rotations, glm::vec3 const *scales, glm::mat4x3 const * const *parents, glm::mat4x3 *local_to_world) {
+	Batch batch;
+	for (uint32_t base = 0; base < count; base += BatchWidth) {
+		uint32_t n = std::min(BatchWidth, count - base);
+
+		//gather:
+		for (uint32_t k = 0; k < BatchWidth; ++k) {
+			glm::mat4x3 const *parent = nullptr;
+			if (k < n) {
+				uint32_t i = base + k;
+				batch.position[0][k] = positions[i].x;
+				batch.position[1][k] = positions[i].y;
+				batch.position[2][k] = positions[i].z;
+				batch.rotation[0][k] = rotations[i].x;
+				batch.rotation[1][k] = rotations[i].y;
+				batch.rotation[2][k] = rotations[i].z;
+				batch.rotation[3][k] = rotations[i].w;
+				batch.scale[0][k] = scales[i].x;
+				batch.scale[1][k] = scales[i].y;
+				batch.scale[2][k] = scales[i].z;
+				parent = parents[i];
+			} else {
+				//unused lanes get harmless values:
+				for (uint32_t j = 0; j < 3; ++j) batch.position[j][k] = 0.0f;
+				for (uint32_t j = 0; j < 4; ++j) batch.rotation[j][k] = (j == 3 ? 1.0f : 0.0f);
+				for (uint32_t j = 0; j < 3; ++j) batch.scale[j][k] = 1.0f;
+			}
+
+			if (!parent) {
+				batch.is_root[k] = -1U;
+				for (uint32_t j = 0; j < 12; ++j) batch.parent[j][k] = 0.0f; //(ignored)
+			} else {
+				batch.is_root[k] = 0;
+				float const *from = glm::value_ptr(*parent);
+				for (uint32_t j = 0; j < 12; ++j) batch.parent[j][k] = from[j];
+			}
+		}
+
+		compute_batch< Lanes >(batch);
+
+		//scatter:
+		for (uint32_t k = 0; k < n; ++k) {
+			float *world = glm::value_ptr(local_to_world[base + k]);
+			for (uint32_t j = 0; j < 12; ++j) world[j] = batch.world[j][k];
+		}
+	}
+}
+
+void Scene::Transform::update_local_to_world(std::vector< Transform const * > *transforms_) {
+	assert(transforms_);
+	std::vector< Transform const * > &pending = *transforms_;
+
+	//current batch:
+	Transform const *batch[KernelWidth];
+	glm::vec3 positions[KernelWidth];
+	glm::quat rotations[KernelWidth];
+	glm::vec3 scales[KernelWidth];
+	glm::mat4x3 const *parents[KernelWidth];
+	glm::mat4x3 results[KernelWidth];
+	uint32_t count = 0;
+
+	auto flush = [&]() {
+		compute_local_to_world(count, positions, rotations, scales, parents, results);
+		for (uint32_t k = 0; k < count; ++k) {
+			batch[k]->local_to_world = results[k];
+			batch[k]->local_to_world_dirty = false;
+			batch[k]->local_to_world_revision += 1;
+		}
+		count = 0;
+	};
+
+	//transforms are batched in list order; a transform whose parent is still dirty (e.g., listed earlier in the
+	// same batch, or not listed at all) waits for the batch to finish, or has its parent computed on the spot:
+	for (Transform const *t : pending) {
+		if (!t->local_to_world_dirty) continue; //(already up to date)
+		if (t->parent && t->parent->local_to_world_dirty) {
+			//parent is either in the current batch or wasn't listed:
+			if (count) flush();
+			if (t->parent->local_to_world_dirty) t->parent->make_local_to_world();
+		}
+		if (std::find(batch, batch + count, t) != batch + count) continue; //(listed twice)
+
+		batch[count] = t;
+		positions[count] = t->position;
+		rotations[count] = t->rotation;
+		scales[count] = t->scale;
+		parents[count] = (t->parent ? &t->parent->local_to_world : nullptr);
+		count += 1;
+		if (count == KernelWidth) flush();
+	}
+	if (count) flush();
+	pending.clear();
+}
+
+void Scene::Transform::set_position(glm::vec3 const &position_) {
+	position = position_;
+	mark_dirty();
+}
+
+void Scene::Transform::set_rotation(glm::quat const &rotation_) {
+	rotation = rotation_;
+	mark_dirty();
+}
+
+void Scene::Transform::set_scale(glm::vec3 const &scale_) {
+	scale = scale_;
+	mark_dirty();
+}
+
+void Scene::Transform::set_parent(Transform *parent_) {
+	if (parent == parent_) return;
+
+	//unlink from old parent's child list:
+	if (parent) {
+		Transform **link = &parent->first_child;
+		while (*link != this) {
+			assert(*link && "transform should be in its parent's child list");
+			link = &(*link)->next_sibling;
+		}
+		*link = next_sibling;
+		next_sibling = nullptr;
+	}
+
+	parent = parent_;
+
+	//link into new parent's child list:
+	if (parent) {
+		next_sibling = parent->first_child;
+		parent->first_child = this;
+	}
+
+	mark_dirty();
+}
+
+std::atomic< uint32_t > Scene::Transform::changes(0);
+std::atomic< uint32_t > Scene::Transform::renames(0);
+
+void Scene::Transform::set_name(std::string const &name_) {
+	name = name_;
+	renames.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Scene::Transform::mark_dirty() {
+	//by the cache invariant, if this transform is fully dirty then so are its descendants:
+	if (local_to_world_dirty && world_to_local_dirty) return;
+
+	if (!local_to_world_dirty) {
+		changes.fetch_add(1, std::memory_order_relaxed);
+		report_moved();
+	}
+
+	local_to_world_dirty = true;
+	world_to_local_dirty = true;
+	for (Transform *child = first_child; child; child = child->next_sibling) {
+		child->mark_dirty();
 	}
 }
 
+void Scene::Transform::report_moved() const {
+	if (moved_list) moved_list->add(this);
+}
+
+Scene::Transform::~Transform() {
+	while (first_child) {
+		first_child->set_parent(nullptr);
+	}
+	set_parent(nullptr);
+}
+
+//-------------------------
+
+std::atomic< uint32_t > Scene::Drawable::pipeline_changes(0);
+
+void Scene::Drawable::set_transform(Transform *transform_) {
+	assert(transform_);
+	transform = transform_;
+	mark_pipeline_changed();
+	mark_bounds_changed();
+}
+
+void Scene::Drawable::set_pipeline(Pipeline const &pipeline_) {
+	pipeline = pipeline_;
+	mark_pipeline_changed();
+}
+
+void Scene::Drawable::mark_pipeline_changed() {
+	pipeline_changes.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::atomic< uint32_t > Scene::Drawable::bounds_changes(0);
+
+void Scene::Drawable::set_bounds(glm::vec3 const &min_, glm::vec3 const &max_) {
+	min = min_;
+	max = max_;
+	mark_bounds_changed();
+}
+
+void Scene::Drawable::mark_bounds_changed() {
+	bounds_changes.fetch_add(1, std::memory_order_relaxed);
+}
+
+//-------------------------
+
+void Scene::watch_transform(Transform const *transform) const {
+	if (transform->moved_list == moved_transforms) return;
+	//(if another scene was watching this transform, it will now miss its moves, so make it check everything)
+	if (transform->moved_list) transform->moved_list->overflowed = true;
+	transform->moved_list = moved_transforms;
+	moved_transforms->limit += 2;
+}
+
+bool Scene::read_moved_transforms(MovedList::Reader *reader, uint32_t *begin, uint32_t *end) const {
+	MovedList &list = *moved_transforms;
+	if (list.overflowed) {
+		//start over (every reader's epoch is now out of date, so each will check everything once):
+		list.transforms.clear();
+		list.overflowed = false;
+		list.epoch += 1;
+	}
+	if (reader->epoch != list.epoch) {
+		sync_moved_transforms(reader);
+		return false;
+	}
+	*begin = reader->read;
+	*end = uint32_t(list.transforms.size());
+	reader->read = *end;
+	return true;
+}
+
+void Scene::sync_moved_transforms(MovedList::Reader *reader) const {
+	reader->read = uint32_t(moved_transforms->transforms.size());
+	reader->epoch = moved_transforms->epoch;
+}
+
+void Scene::trim_moved_transforms() const {
+	MovedList &list = *moved_transforms;
+	//(readers of structures that aren't built will sync when they are built)
+	if (draw_list.built && draw_list.moved.epoch == list.epoch && draw_list.moved.read != list.transforms.size()) return;
+	if (drawables_bvh.built && drawables_bvh.moved.epoch == list.epoch && drawables_bvh.moved.read != list.transforms.size()) return;
+	list.transforms.clear();
+	draw_list.moved.read = 0;
+	drawables_bvh.moved.read = 0;
+}
+
 //-------------------------
 
 glm::mat4 Scene::Camera::make_projection() const {
@@ -87,77 +486,1103 @@ void Scene::draw(Camera const &camera) const {
 	draw(world_to_clip, world_to_light);
 }
 
+bool Scene::Drawable::outside(glm::mat4 const &object_to_clip) const {
+	if (!has_bounds()) return false;
+
+	//checks the clip-space image of the box against each clip plane -- this is conservative,
+	// so boxes near frustum corners may be reported as inside even though they aren't.
+	glm::vec3 center = 0.5f * (max + min);
+	glm::vec3 radius = 0.5f * (max - min);
+
+	glm::vec4 c = object_to_clip * glm::vec4(center, 1.0f);
+	glm::vec4 rx = radius.x * object_to_clip[0];
+	glm::vec4 ry = radius.y * object_to_clip[1];
+	glm::vec4 rz = radius.z * object_to_clip[2];
+
+	//for each plane, the largest value of (w + coord) or (w - coord) over the box:
+	for (uint32_t i = 0; i < 3; ++i) {
+		float w_plus = c.w + c[i] + std::abs(rx.w + rx[i]) + std::abs(ry.w + ry[i]) + std::abs(rz.w + rz[i]);
+		if (w_plus < 0.0f) return true;
+		float w_minus = c.w - c[i] + std::abs(rx.w - rx[i]) + std::abs(ry.w - ry[i]) + std::abs(rz.w - rz[i]);
+		if (w_minus < 0.0f) return true;
+	}
+	return false;
+}
+
+//Pipelines are copied along with drawables (e.g., by Scene::set), so should stay plain data:
+static_assert(std::is_trivially_copyable< Scene::Drawable::Pipeline >::value, "Pipeline should be trivially copyable.");
+
+bool Scene::Drawable::Pipeline::has_uniforms() const {
+	for (auto const &uniform : uniforms) {
+		if (uniform.location != -1U) return true;
+	}
+	return false;
+}
+
+//first unused entry in a pipeline's uniforms:
+static Scene::Drawable::Pipeline::UniformInfo &add_uniform_info(Scene::Drawable::Pipeline &pipeline, GLuint location, Scene::Drawable::Pipeline::UniformInfo::Type type) {
+	for (auto &uniform : pipeline.uniforms) {
+		if (uniform.location == -1U) {
+			uniform = Scene::Drawable::Pipeline::UniformInfo();
+			uniform.location = location;
+			uniform.type = type;
+			return uniform;
+		}
+	}
+	throw std::runtime_error("Pipeline has no room for another uniform (all " + std::to_string(Scene::Drawable::Pipeline::UniformCount) + " are used).");
+}
+
+void Scene::Drawable::Pipeline::add_uniform(GLuint location, GLint value) {
+	add_uniform_info(*this, location, UniformInfo::Int).value.ints[0] = value;
+}
+
+void Scene::Drawable::Pipeline::add_uniform(GLuint location, float value) {
+	add_uniform_info(*this, location, UniformInfo::Float).value.floats[0] = value;
+}
+
+void Scene::Drawable::Pipeline::add_uniform(GLuint location, glm::vec2 const &value) {
+	std::copy(glm::value_ptr(value), glm::value_ptr(value) + 2, add_uniform_info(*this, location, UniformInfo::Vec2).value.floats);
+}
+
+void Scene::Drawable::Pipeline::add_uniform(GLuint location, glm::vec3 const &value) {
+	std::copy(glm::value_ptr(value), glm::value_ptr(value) + 3, add_uniform_info(*this, location, UniformInfo::Vec3).value.floats);
+}
+
+void Scene::Drawable::Pipeline::add_uniform(GLuint location, glm::vec4 const &value) {
+	std::copy(glm::value_ptr(value), glm::value_ptr(value) + 4, add_uniform_info(*this, location, UniformInfo::Vec4).value.floats);
+}
+
+void Scene::Drawable::Pipeline::add_arena_uniform(GLuint location, UniformInfo::Type type, uint32_t offset, uint32_t count) {
+	if (type == UniformInfo::Int) throw std::runtime_error("Int uniforms can't be stored in the uniform arena.");
+	UniformInfo &uniform = add_uniform_info(*this, location, type);
+	uniform.offset = offset;
+	uniform.count = count;
+}
+
+//-------------------------
+
+//world-space bounding box of a drawable (which must have bounds):
+static void world_bounds(Scene::Drawable const &drawable, glm::vec3 *min, glm::vec3 *max) {
+	glm::mat4x3 local_to_world = drawable.transform->make_local_to_world();
+	glm::vec3 center = local_to_world * glm::vec4(0.5f * (drawable.max + drawable.min), 1.0f);
+	glm::vec3 radius = 0.5f * (drawable.max - drawable.min);
+	glm::vec3 world_radius = radius.x * glm::abs(local_to_world[0])
+	                       + radius.y * glm::abs(local_to_world[1])
+	                       + radius.z * glm::abs(local_to_world[2]);
+	*min = center - world_radius;
+	*max = center + world_radius;
+}
+
+void Scene::rebuild_drawables_bvh() const {
+	drawables_bvh.bounds_changes = Drawable::bounds_changes.load(std::memory_order_relaxed);
+	drawables_bvh.unbounded.clear();
+
+	//(compute world matrices in batches before reading them)
+	for (auto const &d : drawables) {
+		if (d.has_bounds() && d.transform->local_to_world_dirty) stale_transforms.emplace_back(d.transform);
+	}
+	Transform::update_local_to_world(&stale_transforms);
+
+	std::vector< BVH::Item > items;
+	items.reserve(drawables.size());
+	for (auto d = drawables.begin(); d != drawables.end(); ++d) {
+		if (d->has_bounds()) {
+			items.emplace_back();
+			world_bounds(*d, &items.back().min, &items.back().max);
+			items.back().id = d.index;
+		} else {
+			drawables_bvh.unbounded.emplace_back(d.index);
+		}
+	}
+	drawables_bvh.bvh.build(items);
+
+	//remember what each item's bounds came from (build() reorders items):
+	drawables_bvh.sources.clear();
+	drawables_bvh.sources.reserve(drawables_bvh.bvh.size());
+	drawables_bvh.items_by_transform.clear();
+	drawables_bvh.items_by_transform.reserve(drawables_bvh.bvh.size());
+	for (uint32_t i = 0; i < drawables_bvh.bvh.size(); ++i) {
+		Drawable const &d = drawables.at_index(drawables_bvh.bvh.items[i].id);
+		drawables_bvh.sources.emplace_back(DrawablesBVH::Source{d.transform, d.transform->local_to_world_revision, d.min, d.max});
+		drawables_bvh.items_by_transform.emplace_back(d.transform, i);
+		//(every item's transform is up to date now, so any later move will be reported)
+		watch_transform(d.transform);
+	}
+	std::sort(drawables_bvh.items_by_transform.begin(), drawables_bvh.items_by_transform.end());
+
+	drawables_bvh.built = true;
+	drawables_bvh.drawables_revision = drawables.revision();
+	sync_moved_transforms(&drawables_bvh.moved);
+	trim_moved_transforms();
+}
+
+void Scene::update_drawables_bvh() const {
+	if (!drawables_bvh.built || drawables_bvh.drawables_revision != drawables.revision()) {
+		//drawables added or removed:
+		rebuild_drawables_bvh();
+		return;
+	}
+
+	//drawables reported changes, or this scene missed some moves, so check everything:
+	uint32_t begin = 0, end = 0;
+	if (drawables_bvh.bounds_changes != Drawable::bounds_changes.load(std::memory_order_relaxed)
+	 || !read_moved_transforms(&drawables_bvh.moved, &begin, &end)) {
+		refit_drawables_bvh();
+		return;
+	}
+
+	//refit the items whose transforms have moved:
+	// (moved entries are only keys; the items' own transform pointers are the ones that can be read)
+	auto find_items = [this](Transform const *transform) {
+		return std::lower_bound(drawables_bvh.items_by_transform.begin(), drawables_bvh.items_by_transform.end(), std::make_pair(transform, 0u));
+	};
+	for (uint32_t m = begin; m < end; ++m) {
+		auto f = find_items(moved_transforms->transforms[m]);
+		if (f != drawables_bvh.items_by_transform.end() && f->first == moved_transforms->transforms[m] && f->first->local_to_world_dirty) {
+			stale_transforms.emplace_back(f->first);
+		}
+	}
+	Transform::update_local_to_world(&stale_transforms);
+
+	drawables_bvh.changed.clear();
+	for (uint32_t m = begin; m < end; ++m) {
+		Transform const *transform = moved_transforms->transforms[m];
+		auto f = find_items(transform);
+		for (; f != drawables_bvh.items_by_transform.end() && f->first == transform; ++f) {
+			uint32_t i = f->second;
+			DrawablesBVH::Source &source = drawables_bvh.sources[i];
+			if (!source.transform->local_to_world_dirty && source.transform->local_to_world_revision == source.local_to_world_revision) continue;
+
+			Drawable const &d = drawables.at_index(drawables_bvh.bvh.items[i].id);
+			glm::vec3 min, max;
+			world_bounds(d, &min, &max); //(n.b. computes local_to_world, updating its revision)
+			drawables_bvh.bvh.set_bounds(i, min, max);
+			source.local_to_world_revision = source.transform->local_to_world_revision;
+			drawables_bvh.changed.emplace_back(i);
+		}
+	}
+	trim_moved_transforms();
+	if (!drawables_bvh.changed.empty()) drawables_bvh.bvh.refit(drawables_bvh.changed);
+}
+
+void Scene::refit_drawables_bvh() const {
+	if (!drawables_bvh.built || drawables_bvh.drawables_revision != drawables.revision()) {
+		rebuild_drawables_bvh();
+		return;
+	}
+	drawables_bvh.bounds_changes = Drawable::bounds_changes.load(std::memory_order_relaxed);
+
+	//drawables that gained bounds need to be added to the tree, so rebuild:
+	for (uint32_t index : drawables_bvh.unbounded) {
+		if (drawables.at_index(index).has_bounds()) {
+			rebuild_drawables_bvh();
+			return;
+		}
+	}
+
+	//refit any items that changed or moved:
+	// (every item's transform is up to date after this, so any later move will be reported)
+	sync_moved_transforms(&drawables_bvh.moved);
+	for (uint32_t i = 0; i < drawables_bvh.bvh.size(); ++i) {
+		Transform const *transform = drawables.at_index(drawables_bvh.bvh.items[i].id).transform;
+		if (transform->local_to_world_dirty) stale_transforms.emplace_back(transform);
+	}
+	Transform::update_local_to_world(&stale_transforms);
+	bool moved = false;
+	for (uint32_t i = 0; i < drawables_bvh.bvh.size(); ++i) {
+		Drawable const &d = drawables.at_index(drawables_bvh.bvh.items[i].id);
+		DrawablesBVH::Source &source = drawables_bvh.sources[i];
+		watch_transform(d.transform);
+		if (d.transform == source.transform
+		 && !d.transform->local_to_world_dirty
+		 && d.transform->local_to_world_revision == source.local_to_world_revision
+		 && d.min == source.min && d.max == source.max) continue;
+
+		if (!d.has_bounds() || d.transform != source.transform) {
+			//drawable lost its bounds (so needs to move to the unbounded list) or changed transforms (so items_by_transform is out of date):
+			rebuild_drawables_bvh();
+			return;
+		}
+
+		glm::vec3 min, max;
+		world_bounds(d, &min, &max);
+		drawables_bvh.bvh.set_bounds(i, min, max);
+		source = DrawablesBVH::Source{d.transform, d.transform->local_to_world_revision, d.min, d.max};
+		moved = true;
+	}
+	trim_moved_transforms();
+	if (moved) drawables_bvh.bvh.refit();
+}
+
+void Scene::find_visible_drawables(glm::mat4 const &world_to_clip, std::vector< uint32_t > *visible) const {
+	assert(visible);
+	update_drawables_bvh();
+	visible->clear();
+	drawables_bvh.bvh.frustum(world_to_clip, visible);
+	visible->insert(visible->end(), drawables_bvh.unbounded.begin(), drawables_bvh.unbounded.end());
+	//report in the same order as the drawables list (so results don't depend on the shape of the tree):
+	std::sort(visible->begin(), visible->end());
+}
+
+void Scene::find_overlapping_drawables(glm::vec3 const &min, glm::vec3 const &max, std::vector< uint32_t > *overlapping) const {
+	assert(overlapping);
+	update_drawables_bvh();
+	overlapping->clear();
+	drawables_bvh.bvh.overlap(min, max, overlapping);
+}
+
+void Scene::find_drawables_in_sphere(glm::vec3 const &center, float radius, std::vector< uint32_t > *found) const {
+	assert(found);
+	update_drawables_bvh();
+	found->clear();
+	drawables_bvh.bvh.overlap_sphere(center, radius, found);
+}
+
+void Scene::find_nearest_drawables(glm::vec3 const &point, uint32_t k, std::vector< uint32_t > *nearest, std::vector< float > *distances, float max_distance) const {
+	assert(nearest);
+	update_drawables_bvh();
+	nearest->clear();
+	if (distances) distances->clear();
+	drawables_bvh.bvh.nearest(point, k, max_distance, nearest, distances);
+}
+
+//distance along a ray at which it hits a drawable's box (in the drawable's local space, so tighter than the world-space box):
+// (affine maps preserve distance along the ray, so the result is in the same units)
+// (if skip_containing is set, boxes that contain origin are missed)
+static float raycast_drawable(Scene::Drawable const &d, glm::vec3 const &origin, glm::vec3 const &direction, bool skip_containing = false) {
+	glm::mat4x3 world_to_local = d.transform->make_world_to_local();
+	glm::vec3 local_origin = world_to_local * glm::vec4(origin, 1.0f);
+	glm::vec3 local_direction = world_to_local * glm::vec4(direction, 0.0f);
+	if (skip_containing
+	 && d.min.x <= local_origin.x && local_origin.x <= d.max.x
+	 && d.min.y <= local_origin.y && local_origin.y <= d.max.y
+	 && d.min.z <= local_origin.z && local_origin.z <= d.max.z) {
+		return std::numeric_limits< float >::infinity();
+	}
+	float t0 = 0.0f;
+	float t1 = std::numeric_limits< float >::infinity();
+	for (uint32_t i = 0; i < 3; ++i) {
+		float a = (d.min[i] - local_origin[i]) / local_direction[i];
+		float b = (d.max[i] - local_origin[i]) / local_direction[i];
+		t0 = std::fmax(t0, std::fmin(a, b));
+		t1 = std::fmin(t1, std::fmax(a, b));
+	}
+	return (t0 <= t1 ? t0 : std::numeric_limits< float >::infinity());
+}
+
+uint32_t Scene::raycast_drawables(glm::vec3 const &origin, glm::vec3 const &direction, float *distance) const {
+	update_drawables_bvh();
+	return drawables_bvh.bvh.raycast(origin, direction, std::numeric_limits< float >::infinity(), [&](uint32_t index, float) {
+		return raycast_drawable(drawables.at_index(index), origin, direction);
+	}, distance);
+}
+
+float Scene::step_fraction(glm::vec3 const &origin, glm::vec3 const &step, float radius) const {
+	float step_length = glm::length(step);
+	if (step_length == 0.0f) return 1.0f;
+	update_drawables_bvh();
+	float distance; //(in units of step)
+	uint32_t hit = drawables_bvh.bvh.raycast(origin, step, std::numeric_limits< float >::infinity(), [&](uint32_t index, float) {
+		return raycast_drawable(drawables.at_index(index), origin, step, true);
+	}, &distance);
+	if (hit == -1U) return 1.0f;
+	return std::min(1.0f, std::max(0.0f, distance - radius / step_length));
+}
+
+void Scene::raycast_drawables(std::vector< Ray > const &rays, std::vector< RayHit > *hits) const {
+	assert(hits);
+	update_drawables_bvh();
+	hits->assign(rays.size(), RayHit());
+	for (size_t i = 0; i < rays.size(); ++i) {
+		Ray const &ray = rays[i];
+		RayHit &hit = (*hits)[i];
+		hit.drawable = drawables_bvh.bvh.raycast(ray.origin, ray.direction, std::numeric_limits< float >::infinity(), [&](uint32_t index, float) {
+			return raycast_drawable(drawables.at_index(index), ray.origin, ray.direction);
+		}, &hit.distance);
+	}
+}
+
+void Scene::find_overlapping_drawables(std::vector< Box > const &boxes, std::vector< glm::uvec2 > *ranges, std::vector< uint32_t > *overlapping) const {
+	assert(ranges);
+	assert(overlapping);
+	update_drawables_bvh();
+	ranges->clear();
+	ranges->reserve(boxes.size());
+	overlapping->clear();
+	for (Box const &box : boxes) {
+		uint32_t first = uint32_t(overlapping->size());
+		drawables_bvh.bvh.overlap(box.min, box.max, overlapping);
+		ranges->emplace_back(first, uint32_t(overlapping->size()) - first);
+	}
+}
+
+//-------------------------
+
+static uint32_t name_hash(std::string_view name) {
+	return uint32_t(std::hash< std::string_view >()(name));
+}
+
+//does name match pattern? ('*' matches any run of characters, '?' any one character)
+static bool name_matches(std::string_view name, std::string_view pattern) {
+	size_t n = 0, p = 0;
+	size_t star = std::string_view::npos, star_n = 0; //most recent '*' and where its match ends
+	while (n < name.size()) {
+		if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n])) {
+			++n;
+			++p;
+		} else if (p < pattern.size() && pattern[p] == '*') {
+			star = p++;
+			star_n = n;
+		} else if (star != std::string_view::npos) {
+			//let the most recent '*' match one more character and try again:
+			p = star + 1;
+			n = ++star_n;
+		} else {
+			return false;
+		}
+	}
+	while (p < pattern.size() && pattern[p] == '*') ++p;
+	return p == pattern.size();
+}
+
+void Scene::update_name_index() const {
+	uint32_t renames = Transform::renames.load(std::memory_order_relaxed);
+	if (name_index.built && name_index.transforms_revision == transforms.revision() && name_index.renames == renames) return;
+
+	name_index.built = true;
+	name_index.transforms_revision = transforms.revision();
+	name_index.renames = renames;
+
+	uint32_t size = 16;
+	while (size < 2 * transforms.size()) size *= 2;
+	name_index.table.assign(size, NameIndex::Entry());
+	name_index.sorted.clear();
+	name_index.sorted.reserve(transforms.size());
+
+	//(inserting in slot order keeps same-named entries in slot order along each probe sequence)
+	for (auto t = transforms.begin(); t != transforms.end(); ++t) {
+		uint32_t hash = name_hash(t->name);
+		uint32_t i = hash & (size - 1);
+		while (name_index.table[i].slot != -1U) i = (i + 1) & (size - 1);
+		name_index.table[i].hash = hash;
+		name_index.table[i].slot = t.index;
+		name_index.sorted.emplace_back(t.index);
+	}
+
+	std::stable_sort(name_index.sorted.begin(), name_index.sorted.end(), [this](uint32_t a, uint32_t b) {
+		return transforms.at_index(a).name < transforms.at_index(b).name;
+	});
+}
+
+uint32_t Scene::find_transform_slot(std::string_view name) const {
+	update_name_index();
+	uint32_t hash = name_hash(name);
+	uint32_t mask = uint32_t(name_index.table.size()) - 1;
+	for (uint32_t i = hash & mask; name_index.table[i].slot != -1U; i = (i + 1) & mask) {
+		NameIndex::Entry const &entry = name_index.table[i];
+		if (entry.hash == hash && transforms.at_index(entry.slot).name == name) return entry.slot;
+	}
+	return -1U;
+}
+
+Scene::Transform *Scene::find_transform(std::string_view name) {
+	uint32_t slot = find_transform_slot(name);
+	return (slot == -1U ? nullptr : &transforms.at_index(slot));
+}
+
+Scene::Transform const *Scene::find_transform(std::string_view name) const {
+	uint32_t slot = find_transform_slot(name);
+	return (slot == -1U ? nullptr : &transforms.at_index(slot));
+}
+
+void Scene::find_transforms(std::string_view pattern, std::vector< Transform * > *found_) {
+	assert(found_);
+	auto &found = *found_;
+	found.clear();
+	update_name_index();
+
+	size_t wildcard = pattern.find_first_of("*?");
+	if (wildcard == std::string_view::npos) {
+		//no wildcards, so every match has the same hash:
+		uint32_t hash = name_hash(pattern);
+		uint32_t mask = uint32_t(name_index.table.size()) - 1;
+		for (uint32_t i = hash & mask; name_index.table[i].slot != -1U; i = (i + 1) & mask) {
+			NameIndex::Entry const &entry = name_index.table[i];
+			if (entry.hash == hash && transforms.at_index(entry.slot).name == pattern) {
+				found.emplace_back(&transforms.at_index(entry.slot));
+			}
+		}
+		return;
+	}
+
+	//only names starting with the pattern's literal prefix can match:
+	std::string_view prefix = pattern.substr(0, wildcard);
+	auto begin = std::lower_bound(name_index.sorted.begin(), name_index.sorted.end(), prefix, [this](uint32_t slot, std::string_view prefix) {
+		return std::string_view(transforms.at_index(slot).name) < prefix;
+	});
+	std::vector< uint32_t > slots;
+	for (auto s = begin; s != name_index.sorted.end(); ++s) {
+		std::string_view name = transforms.at_index(*s).name;
+		if (name.substr(0, prefix.size()) != prefix) break;
+		if (name_matches(name.substr(prefix.size()), pattern.substr(prefix.size()))) slots.emplace_back(*s);
+	}
+
+	std::sort(slots.begin(), slots.end());
+	found.reserve(slots.size());
+	for (uint32_t slot : slots) {
+		found.emplace_back(&transforms.at_index(slot));
+	}
+}
+
+//-------------------------
+
+void Scene::BufferTexture::upload(GLenum format, void const *data, size_t size, GLenum usage) {
+	if (buffer == 0) {
+		glGenBuffers(1, &buffer);
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_BUFFER, texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	glBufferData(GL_TEXTURE_BUFFER, size, data, usage);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void Scene::BufferTexture::update(size_t offset, void const *data, size_t size) {
+	assert(buffer != 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	glBufferSubData(GL_TEXTURE_BUFFER, offset, size, data);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void Scene::BufferTexture::release() {
+	if (buffer != 0) {
+		glDeleteTextures(1, &texture);
+		glDeleteBuffers(1, &buffer);
+		texture = 0;
+		buffer = 0;
+	}
+}
+
+void Scene::release_buffers() const {
+	draw_list.instances_texture.release();
+	draw_list.slots_texture.release();
+	draw_list.lights_texture.release();
+	draw_list.light_ranges_texture.release();
+	draw_list.light_indices_texture.release();
+	draw_list.uploaded = false; //(matrices must be sent again if this scene is drawn again)
+}
+
+//largest buffer texture (in texels) OpenGL will sample from:
+static uint32_t max_buffer_texels() {
+	static GLint max = 0;
+	if (max == 0) {
+		max = 65536; //(minimum the GL spec allows)
+		glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max);
+	}
+	return uint32_t(max);
+}
+
+//set a pipeline's (non-matrix-slot) uniforms:
+static void set_uniforms(Scene::Drawable::Pipeline const &pipeline, std::vector< float > const &arena) {
+	typedef Scene::Drawable::Pipeline::UniformInfo UniformInfo;
+	for (UniformInfo const &uniform : pipeline.uniforms) {
+		if (uniform.location == -1U) continue;
+
+		GLint location = GLint(uniform.location);
+		if (uniform.type == UniformInfo::Int) {
+			glUniform1i(location, uniform.value.ints[0]);
+			continue;
+		}
+
+		//values are inline unless they have an offset (matrices always do):
+		float const *data = uniform.value.floats;
+		GLsizei count = 1;
+		if (uniform.offset != -1U) {
+			static const uint32_t Floats[] = {1, 1, 2, 3, 4, 9, 12, 16}; //per value, indexed by type
+			if (uniform.offset > arena.size() || size_t(uniform.count) * Floats[uniform.type] > arena.size() - uniform.offset) {
+				throw std::runtime_error("Uniform at location " + std::to_string(uniform.location) + " reads past the end of uniform_arena.");
+			}
+			data = arena.data() + uniform.offset;
+			count = GLsizei(uniform.count);
+		} else if (uniform.type >= UniformInfo::Mat3) {
+			throw std::runtime_error("Matrix uniform at location " + std::to_string(uniform.location) + " has no uniform_arena offset.");
+		}
+
+		switch (uniform.type) {
+			case UniformInfo::Int: break; //(handled above)
+			case UniformInfo::Float: glUniform1fv(location, count, data); break;
+			case UniformInfo::Vec2: glUniform2fv(location, count, data); break;
+			case UniformInfo::Vec3: glUniform3fv(location, count, data); break;
+			case UniformInfo::Vec4: glUniform4fv(location, count, data); break;
+			case UniformInfo::Mat3: glUniformMatrix3fv(location, count, GL_FALSE, data); break;
+			case UniformInfo::Mat4x3: glUniformMatrix4x3fv(location, count, GL_FALSE, data); break;
+			case UniformInfo::Mat4: glUniformMatrix4fv(location, count, GL_FALSE, data); break;
+		}
+	}
+}
+
+//number of simpler LODs a drawable has:
+static uint32_t lod_count(Scene::Drawable const &drawable) {
+	if (!drawable.has_bounds()) return 0; //(screen size comes from bounds)
+	uint32_t count = 0;
+	while (count < Scene::Drawable::LODCount && drawable.lods[count].count != 0) ++count;
+	return count;
+}
+
+void Scene::update_draw_list() const {
+	uint32_t pipeline_changes = Drawable::pipeline_changes.load(std::memory_order_relaxed);
+	bool check_all = false; //check every buffered member's matrices (rather than just those whose transforms moved)
+	if (!draw_list.built || draw_list.drawables_revision != drawables.revision() || draw_list.pipeline_changes != pipeline_changes) {
+		draw_stats.draw_list_rebuilt = true;
+
+		//(program that will actually be used for a pipeline -- buffered drawables use instanced_program)
+		auto used_program = [](Drawable::Pipeline const &pipeline) {
+			return (pipeline.instanced_program != 0 && !pipeline.has_uniforms() ? pipeline.instanced_program : pipeline.program);
+		};
+
+		//Gather the drawables that can be drawn:
+		std::vector< uint32_t > order;
+		order.reserve(drawables.size());
+		for (auto d = drawables.begin(); d != drawables.end(); ++d) {
+			//skip any drawables without a shader program set:
+			if (d->pipeline.program == 0) continue;
+			//skip any drawables that don't reference any vertex array:
+			if (d->pipeline.vao == 0) continue;
+			//skip any drawables that don't contain any vertices:
+			if (d->pipeline.count == 0) continue;
+			assert(d->transform); //drawables *must* have a transform
+			order.emplace_back(d.index);
+		}
+
+		//Sort by program, then vertex array, then textures, so that drawables sharing state end up next to each other;
+		// then by which vertices they draw, so that drawables that can be instanced together are also next to each other:
+		std::stable_sort(order.begin(), order.end(), [this,&used_program](uint32_t ia, uint32_t ib) {
+			Drawable::Pipeline const &pa = drawables.at_index(ia).pipeline;
+			Drawable::Pipeline const &pb = drawables.at_index(ib).pipeline;
+			if (used_program(pa) != used_program(pb)) return used_program(pa) < used_program(pb);
+			if (pa.program != pb.program) return pa.program < pb.program;
+			if (pa.vao != pb.vao) return pa.vao < pb.vao;
+			for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+				if (pa.textures[i].texture != pb.textures[i].texture) return pa.textures[i].texture < pb.textures[i].texture;
+			}
+			if (pa.start != pb.start) return pa.start < pb.start;
+			if (pa.count != pb.count) return pa.count < pb.count;
+			if (pa.type != pb.type) return pa.type < pb.type;
+			if (pa.index_type != pb.index_type) return pa.index_type < pb.index_type;
+			if (pa.base_vertex != pb.base_vertex) return pa.base_vertex < pb.base_vertex;
+			//(then by LODs -- only drawables with the same LODs can share a command)
+			Drawable const &da = drawables.at_index(ia);
+			Drawable const &db = drawables.at_index(ib);
+			uint32_t la = lod_count(da);
+			uint32_t lb = lod_count(db);
+			if (la != lb) return la < lb;
+			for (uint32_t i = 0; i < la; ++i) {
+				if (da.lods[i].start != db.lods[i].start) return da.lods[i].start < db.lods[i].start;
+				if (da.lods[i].count != db.lods[i].count) return da.lods[i].count < db.lods[i].count;
+				if (da.lods[i].type != db.lods[i].type) return da.lods[i].type < db.lods[i].type;
+				if (da.lods[i].screen_size != db.lods[i].screen_size) return da.lods[i].screen_size < db.lods[i].screen_size;
+				if (da.lods[i].base_vertex != db.lods[i].base_vertex) return da.lods[i].base_vertex < db.lods[i].base_vertex;
+			}
+			return false;
+		});
+
+		//Split into commands: runs of drawables that differ only by transform become one buffered command
+		// (if their pipeline has an instanced_program and there is room for their matrices); everything else is drawn alone:
+		draw_list.commands.clear();
+		draw_list.members.clear();
+		draw_list.members.reserve(order.size());
+		uint32_t max_members = max_buffer_texels() / Drawable::Pipeline::InstanceTexels;
+		for (uint32_t begin = 0; begin < order.size(); /* later */) {
+			Drawable const &drawable = drawables.at_index(order[begin]);
+			Drawable::Pipeline const &pipeline = drawable.pipeline;
+			uint32_t end = begin + 1;
+			bool buffered = (pipeline.instanced_program != 0 && !pipeline.has_uniforms() && draw_list.members.size() < max_members);
+			if (buffered) {
+				while (end < order.size() && draw_list.members.size() + (end - begin) < max_members) {
+					Drawable::Pipeline const &other = drawables.at_index(order[end]).pipeline;
+					if (other.has_uniforms()) break;
+					if (other.program != pipeline.program || other.instanced_program != pipeline.instanced_program
+					 || other.INSTANCE_FIRST_int != pipeline.INSTANCE_FIRST_int || other.vao != pipeline.vao
+					 || other.type != pipeline.type || other.start != pipeline.start || other.count != pipeline.count
+					 || other.index_type != pipeline.index_type || other.base_vertex != pipeline.base_vertex
+					 || other.uses_lights != pipeline.uses_lights) break;
+					bool same_textures = true;
+					for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+						if (other.textures[i].texture != pipeline.textures[i].texture
+						 || (other.textures[i].texture != 0 && other.textures[i].target != pipeline.textures[i].target)) {
+							same_textures = false;
+							break;
+						}
+					}
+					if (!same_textures) break;
+					Drawable const &other_drawable = drawables.at_index(order[end]);
+					uint32_t lods = lod_count(drawable);
+					if (lod_count(other_drawable) != lods) break;
+					bool same_lods = true;
+					for (uint32_t i = 0; i < lods; ++i) {
+						if (other_drawable.lods[i].type != drawable.lods[i].type || other_drawable.lods[i].start != drawable.lods[i].start
+						 || other_drawable.lods[i].count != drawable.lods[i].count || other_drawable.lods[i].screen_size != drawable.lods[i].screen_size
+						 || other_drawable.lods[i].base_vertex != drawable.lods[i].base_vertex) {
+							same_lods = false;
+							break;
+						}
+					}
+					if (!same_lods) break;
+					++end;
+				}
+			}
+
+			DrawList::Command command;
+			command.drawable = &drawable;
+			command.program = (buffered ? pipeline.instanced_program : pipeline.program);
+			command.vao = pipeline.vao;
+			command.type = pipeline.type;
+			command.start = pipeline.start;
+			command.count = pipeline.count;
+			command.index_type = pipeline.index_type;
+			command.base_vertex = pipeline.base_vertex;
+			for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+				command.textures[i] = pipeline.textures[i];
+			}
+			command.buffered = buffered;
+			command.uses_lights = pipeline.uses_lights;
+			command.lod_count = lod_count(drawable);
+			for (uint32_t i = 0; i < Drawable::LODCount; ++i) {
+				command.lods[i] = (i < command.lod_count ? drawable.lods[i] : Drawable::LOD());
+			}
+			command.first_member = uint32_t(draw_list.members.size());
+			command.member_count = end - begin;
+			draw_list.commands.emplace_back(command);
+			draw_list.members.insert(draw_list.members.end(), order.begin() + begin, order.begin() + end);
+			begin = end;
+		}
+
+		//where each member (and drawable) is in the list:
+		draw_list.member_commands.resize(draw_list.members.size());
+		for (uint32_t c = 0; c < draw_list.commands.size(); ++c) {
+			DrawList::Command const &command = draw_list.commands[c];
+			std::fill(draw_list.member_commands.begin() + command.first_member, draw_list.member_commands.begin() + command.first_member + command.member_count, c);
+		}
+		draw_list.drawable_members.assign(drawables.slots(), -1U);
+		for (uint32_t m = 0; m < draw_list.members.size(); ++m) {
+			draw_list.drawable_members[draw_list.members[m]] = m;
+		}
+
+		//watch the transforms of buffered members, so that only the matrices of those that move need to be checked:
+		draw_list.buffered_by_transform.clear();
+		for (auto const &command : draw_list.commands) {
+			if (!command.buffered) continue;
+			for (uint32_t m = command.first_member; m < command.first_member + command.member_count; ++m) {
+				Transform const *transform = drawables.at_index(draw_list.members[m]).transform;
+				draw_list.buffered_by_transform.emplace_back(transform, m);
+			}
+		}
+		std::sort(draw_list.buffered_by_transform.begin(), draw_list.buffered_by_transform.end());
+
+		//matrices will all be computed below:
+		draw_list.sources.assign(draw_list.members.size(), DrawList::Source{nullptr, 0});
+		draw_list.instances.assign(draw_list.members.size() * Drawable::Pipeline::InstanceTexels, glm::vec4(0.0f));
+		draw_list.uploaded = false;
+		draw_list.built = true;
+		draw_list.drawables_revision = drawables.revision();
+		draw_list.pipeline_changes = pipeline_changes;
+		check_all = true;
+	}
+
+	//Patch the matrices of buffered drawables whose transforms have moved:
+	draw_list.changed.clear();
+	auto patch = [this](uint32_t m) {
+		Transform const *transform = drawables.at_index(draw_list.members[m]).transform;
+		glm::mat4x3 object_to_world = transform->make_local_to_world();
+		DrawList::Source &source = draw_list.sources[m];
+		if (source.transform == transform && source.local_to_world_revision == transform->local_to_world_revision) return;
+		source.transform = transform;
+		source.local_to_world_revision = transform->local_to_world_revision;
+
+		glm::mat3 normal_to_world = glm::inverse(glm::transpose(glm::mat3(object_to_world)));
+		glm::vec4 *out = draw_list.instances.data() + size_t(m) * Drawable::Pipeline::InstanceTexels;
+		for (uint32_t r = 0; r < 3; ++r) {
+			*(out++) = glm::vec4(object_to_world[0][r], object_to_world[1][r], object_to_world[2][r], object_to_world[3][r]);
+		}
+		for (uint32_t c = 0; c < 3; ++c) {
+			*(out++) = glm::vec4(normal_to_world[c], 0.0f);
+		}
+		draw_list.changed.emplace_back(m);
+		draw_stats.matrices_updated += 1;
+	};
+	uint32_t begin = 0, end = 0;
+	if (!check_all && !read_moved_transforms(&draw_list.moved, &begin, &end)) check_all = true;
+	if (check_all) {
+		//(after this, every buffered member's transform is up to date -- so any later move will be reported)
+		for (auto const &entry : draw_list.buffered_by_transform) {
+			watch_transform(entry.first);
+		}
+		sync_moved_transforms(&draw_list.moved);
+		//(compute world matrices in batches before reading them)
+		for (auto const &entry : draw_list.buffered_by_transform) {
+			if (entry.first->local_to_world_dirty) stale_transforms.emplace_back(entry.first);
+		}
+		Transform::update_local_to_world(&stale_transforms);
+		for (auto const &entry : draw_list.buffered_by_transform) {
+			patch(entry.second);
+		}
+	} else {
+		//(moved entries are only keys; the members' own transform pointers are the ones that can be read)
+		auto find_members = [this](Transform const *transform) {
+			return std::lower_bound(draw_list.buffered_by_transform.begin(), draw_list.buffered_by_transform.end(), std::make_pair(transform, 0u));
+		};
+		for (uint32_t i = begin; i < end; ++i) {
+			auto f = find_members(moved_transforms->transforms[i]);
+			if (f != draw_list.buffered_by_transform.end() && f->first == moved_transforms->transforms[i] && f->first->local_to_world_dirty) {
+				stale_transforms.emplace_back(f->first);
+			}
+		}
+		Transform::update_local_to_world(&stale_transforms);
+		for (uint32_t i = begin; i < end; ++i) {
+			Transform const *transform = moved_transforms->transforms[i];
+			auto f = find_members(transform);
+			for (; f != draw_list.buffered_by_transform.end() && f->first == transform; ++f) {
+				patch(f->second);
+			}
+		}
+	}
+	trim_moved_transforms();
+
+	//Send changed matrices to the GPU:
+	if (!draw_list.uploaded) {
+		draw_list.instances_texture.upload(GL_RGBA32F, draw_list.instances.data(), draw_list.instances.size() * sizeof(glm::vec4), GL_DYNAMIC_DRAW);
+		draw_list.uploaded = true;
+	} else {
+		//(in ranges of nearby members -- re-sending a few unchanged matrices is cheaper than another call)
+		std::sort(draw_list.changed.begin(), draw_list.changed.end());
+		size_t stride = Drawable::Pipeline::InstanceTexels * sizeof(glm::vec4);
+		for (uint32_t i = 0; i < draw_list.changed.size(); /* later */) {
+			uint32_t first = draw_list.changed[i];
+			uint32_t last = first;
+			for (++i; i < draw_list.changed.size() && draw_list.changed[i] <= last + 9; ++i) {
+				last = draw_list.changed[i];
+			}
+			draw_list.instances_texture.update(first * stride, draw_list.instances.data() + size_t(first) * Drawable::Pipeline::InstanceTexels, (last + 1 - first) * stride);
+		}
+	}
+}
+
 void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+	draw_stats = DrawStats();
+
+	//Bring commands and matrices up to date:
+	update_draw_list();
+
+	//Find drawables that might be visible:
+	std::vector< uint32_t > &visible = draw_list.visible;
+	visible.clear();
+	find_visible_drawables(world_to_clip, &visible);
+	draw_stats.culled += drawables.size() - uint32_t(visible.size());
+	//...and where they are in the draw list (sorting members groups them by command, in command order):
+	std::vector< uint32_t > &visible_members = draw_list.visible_members;
+	visible_members.clear();
+	for (uint32_t index : visible) {
+		uint32_t m = draw_list.drawable_members[index];
+		if (m != -1U) visible_members.emplace_back(m);
+	}
+	std::sort(visible_members.begin(), visible_members.end());
+
+	//Screen size of a bounding sphere is radius * y_scale / w, where w is the clip w of its center:
+	glm::vec4 w_row = glm::transpose(world_to_clip)[3];
+	float y_scale = glm::length(glm::vec3(glm::transpose(world_to_clip)[1])); //(clip y per unit distance, i.e., 1 / tan(fovy / 2))
+	auto screen_size = [&](glm::mat4x3 const &local_to_world, glm::vec3 const &min, glm::vec3 const &max) {
+		glm::vec3 center = local_to_world * glm::vec4(0.5f * (min + max), 1.0f);
+		float scale = std::max(std::max(glm::length(local_to_world[0]), glm::length(local_to_world[1])), glm::length(local_to_world[2]));
+		float radius = 0.5f * glm::length(max - min) * scale;
+		float w = glm::dot(w_row, glm::vec4(center, 1.0f));
+		return (w > radius ? radius * y_scale / w : std::numeric_limits< float >::infinity());
+	};
 
-	//Iterate through all drawables, sending each one to OpenGL:
-	for (auto const &drawable : drawables) {
-		//Reference to drawable's pipeline for convenience:
-		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+	//Draw big, nearby occluders into the occlusion buffer:
+	bool occlusion = false;
+	if (max_occluders != 0) {
+		std::vector< std::pair< float, uint32_t > > &occluders = draw_list.occluders;
+		occluders.clear();
+		for (uint32_t index : visible) {
+			Drawable const &drawable = drawables.at_index(index);
+			if (!drawable.is_occluder()) continue;
+			float size = screen_size(drawable.transform->make_local_to_world(), drawable.occluder_min, drawable.occluder_max);
+			if (size >= occluder_screen_size) occluders.emplace_back(-size, index);
+		}
+		if (occluders.size() > max_occluders) {
+			std::nth_element(occluders.begin(), occluders.begin() + max_occluders, occluders.end());
+			occluders.resize(max_occluders);
+		}
+		if (!occluders.empty()) {
+			occlusion_buffer.clear();
+			for (auto const &o : occluders) {
+				Drawable const &drawable = drawables.at_index(o.second);
+				glm::mat4 object_to_clip = world_to_clip * glm::mat4(drawable.transform->make_local_to_world());
+				occlusion_buffer.add_box(object_to_clip, drawable.occluder_min, drawable.occluder_max);
+			}
+			draw_stats.occluders = uint32_t(occluders.size());
+			occlusion = true;
+		}
+	}
 
-		//skip any drawables without a shader program set:
-		if (pipeline.program == 0) continue;
-		//skip any drawables that don't reference any vertex array:
-		if (pipeline.vao == 0) continue;
-		//skip any drawables that don't contain any vertices:
-		if (pipeline.count == 0) continue;
+	//Decide which visible members of each command to draw (and with which LOD):
+	typedef DrawList::Draw Draw;
+	std::vector< Draw > &draws = draw_list.draws;
+	draws.clear();
+	std::vector< uint32_t > &slots = draw_list.slots;
+	slots.clear();
+	bool lit = false;
+	std::vector< glm::uvec2 > &picked = draw_list.picked;
+	for (uint32_t v = 0; v < visible_members.size(); /* later */) {
+		DrawList::Command const &command = draw_list.commands[draw_list.member_commands[visible_members[v]]];
+		picked.clear();
+		uint32_t lod_used = 0; //bit i set if lod i is used
+		for (; v < visible_members.size() && visible_members[v] < command.first_member + command.member_count; ++v) {
+			uint32_t m = visible_members[v];
+			uint32_t index = draw_list.members[m];
+
+			//skip any drawables whose bounds are outside the view frustum:
+			// (the hierarchy tests world-space boxes; this tighter test uses the object-space box)
+			Drawable const &drawable = drawables.at_index(index);
+			glm::mat4x3 local_to_world = drawable.transform->make_local_to_world();
+			glm::mat4 object_to_clip = world_to_clip * glm::mat4(local_to_world);
+			if (drawable.outside(object_to_clip)) {
+				draw_stats.culled += 1;
+				continue;
+			}
 
+			//...and any whose bounds are hidden behind occluders:
+			if (occlusion && drawable.has_bounds() && occlusion_buffer.occluded(object_to_clip, drawable.min, drawable.max)) {
+				draw_stats.occluded += 1;
+				continue;
+			}
 
-		//Set shader program:
-		glUseProgram(pipeline.program);
+			uint32_t lod = 0;
+			if (command.lod_count != 0) {
+				float size = screen_size(local_to_world, drawable.min, drawable.max);
 
-		//Set attribute sources:
-		glBindVertexArray(pipeline.vao);
+				//step to coarser or finer levels only once the size is clearly past a threshold:
+				lod = std::min(uint32_t(drawable.lod), command.lod_count);
+				while (lod < command.lod_count && size < command.lods[lod].screen_size * (1.0f - Drawable::LODHysteresis)) ++lod;
+				while (lod > 0 && size > command.lods[lod - 1].screen_size * (1.0f + Drawable::LODHysteresis)) --lod;
+				drawable.lod = uint8_t(lod);
+				if (lod != 0) draw_stats.reduced_lod += 1;
+			}
+			picked.emplace_back(m, lod);
+			lod_used |= (1u << lod);
+		}
 
-		//Configure program uniforms:
+		//one draw per lod used:
+		for (uint32_t lod = 0; lod <= command.lod_count; ++lod) {
+			if (!(lod_used & (1u << lod))) continue;
+			Draw draw{&command, uint32_t(slots.size()), 0, lod};
+			for (auto const &p : picked) {
+				if (p.y != lod) continue;
+				if (command.buffered) {
+					slots.emplace_back(p.x);
+				} else {
+					draw.first = p.x;
+				}
+				draw.count += 1;
+			}
+			draws.emplace_back(draw);
+		}
+		lit = lit || (lod_used && command.uses_lights);
+	}
 
-		//the object-to-world matrix is used in all three of these uniforms:
-		assert(drawable.transform); //drawables *must* have a transform
-		glm::mat4x3 object_to_world = drawable.transform->make_local_to_world();
+	//Upload per-draw data:
+	// (all uploads happen before any buffer textures are bound, since creating one disturbs bindings)
+	if (!slots.empty()) {
+		draw_list.slots_texture.upload(GL_R32UI, slots.data(), slots.size() * sizeof(uint32_t));
+	}
 
-		//OBJECT_TO_CLIP takes vertices from object space to clip space:
-		if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
-			glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world);
-			glUniformMatrix4fv(pipeline.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip));
+	//Bin lights into clusters, for programs that loop over them:
+	if (lit) {
+		std::vector< LightClusters::Light > &cluster_lights = draw_list.cluster_lights;
+		cluster_lights.clear();
+		for (auto const &light : lights) {
+			LightClusters::Light l;
+			if (light.type == Light::Point) l.type = LightClusters::Light::Point;
+			else if (light.type == Light::Hemisphere) l.type = LightClusters::Light::Hemisphere;
+			else if (light.type == Light::Spot) l.type = LightClusters::Light::Spot;
+			else l.type = LightClusters::Light::Directional;
+			glm::mat4x3 light_to_world = light.transform->make_local_to_world();
+			l.position = light_to_world[3];
+			l.direction = -glm::normalize(light_to_world[2]); //(lights point along -z)
+			l.energy = light.energy;
+			l.cutoff = std::cos(0.5f * light.spot_fov);
+			l.range = light.distance;
+			cluster_lights.emplace_back(l);
 		}
+		light_clusters.build(world_to_clip, world_to_light, cluster_lights, max_buffer_texels());
+		draw_stats.lights = uint32_t(light_clusters.lights_data.size()) / 3;
+		draw_stats.lights_dropped = light_clusters.dropped;
 
-		//the object-to-light matrix is used in the next two uniforms:
-		glm::mat4x3 object_to_light = world_to_light * glm::mat4(object_to_world);
+		draw_list.lights_texture.upload(GL_RGBA32F, light_clusters.lights_data.data(), light_clusters.lights_data.size() * sizeof(glm::vec4));
+		draw_list.light_ranges_texture.upload(GL_RG32UI, light_clusters.ranges.data(), light_clusters.ranges.size() * sizeof(glm::uvec2));
+		draw_list.light_indices_texture.upload(GL_R32UI, light_clusters.indices.data(), light_clusters.indices.size() * sizeof(uint32_t));
+	}
 
-		//OBJECT_TO_CLIP takes vertices from object space to light space:
-		if (pipeline.OBJECT_TO_LIGHT_mat4x3 != -1U) {
-			glUniformMatrix4x3fv(pipeline.OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(object_to_light));
+	//Currently-bound state (only changed when a drawable needs something different):
+	GLuint bound_program = 0;
+	GLuint bound_vao = 0;
+	Drawable::Pipeline::TextureInfo bound_textures[Drawable::Pipeline::TextureCount];
+	uint32_t active_texture = 0;
+	std::vector< GLuint > &programs_with_world_uniforms = draw_list.programs_with_world_uniforms;
+	programs_with_world_uniforms.clear();
+
+	//Bind buffer textures:
+	auto bind_buffer_texture = [&](uint32_t unit, BufferTexture const &buffer_texture) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_BUFFER, buffer_texture.texture);
+		active_texture = unit;
+		draw_stats.state_changes += 1;
+	};
+	if (!slots.empty()) {
+		bind_buffer_texture(Drawable::Pipeline::InstancesTextureUnit, draw_list.instances_texture);
+		bind_buffer_texture(Drawable::Pipeline::InstanceSlotsTextureUnit, draw_list.slots_texture);
+	}
+	if (lit) {
+		bind_buffer_texture(Drawable::Pipeline::LightsTextureUnit, draw_list.lights_texture);
+		bind_buffer_texture(Drawable::Pipeline::LightRangesTextureUnit, draw_list.light_ranges_texture);
+		bind_buffer_texture(Drawable::Pipeline::LightIndicesTextureUnit, draw_list.light_indices_texture);
+	}
+
+	//Replay commands, sending each to OpenGL:
+	for (Draw const &draw : draws) {
+		DrawList::Command const &command = *draw.command;
+		Drawable::Pipeline const &pipeline = command.drawable->pipeline;
+		draw_stats.drawn += draw.count;
+		draw_stats.draw_calls += 1;
+		if (draw.count > 1) draw_stats.instanced += draw.count;
+		if (command.buffered) draw_stats.buffered += draw.count;
+
+		//(what a draw without state tracking would have done: program + vertex array + bind and un-bind each texture)
+		draw_stats.state_changes_elided += 2 * draw.count;
+
+		//Set shader program:
+		if (command.program != bound_program) {
+			glUseProgram(command.program);
+			bound_program = command.program;
+			draw_stats.state_changes += 1;
 		}
 
-		//NORMAL_TO_CLIP takes normals from object space to light space:
-		if (pipeline.NORMAL_TO_LIGHT_mat3 != -1U) {
-			glm::mat3 normal_to_light = glm::inverse(glm::transpose(glm::mat3(object_to_light)));
-			glUniformMatrix3fv(pipeline.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(normal_to_light));
+		//Set attribute sources:
+		if (command.vao != bound_vao) {
+			glBindVertexArray(command.vao);
+			bound_vao = command.vao;
+			draw_stats.state_changes += 1;
 		}
 
-		//set any requested custom uniforms:
-		if (pipeline.set_uniforms) pipeline.set_uniforms();
+		//Configure program uniforms:
+		if (command.buffered) {
+			//per-frame matrices (set once per program):
+			if (std::find(programs_with_world_uniforms.begin(), programs_with_world_uniforms.end(), command.program) == programs_with_world_uniforms.end()) {
+				if (pipeline.WORLD_TO_CLIP_mat4 != -1U) {
+					glUniformMatrix4fv(pipeline.WORLD_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(world_to_clip));
+				}
+				if (pipeline.WORLD_TO_LIGHT_mat4x3 != -1U) {
+					glUniformMatrix4x3fv(pipeline.WORLD_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(world_to_light));
+				}
+				programs_with_world_uniforms.emplace_back(command.program);
+			}
+			//per-object matrices come from the instances buffer, via slots starting here:
+			glUniform1i(pipeline.INSTANCE_FIRST_int, GLint(draw.first));
+		} else {
+			Drawable const &drawable = drawables.at_index(draw_list.members[draw.first]);
+
+			//the object-to-world matrix is used in all three of these uniforms:
+			glm::mat4x3 object_to_world = drawable.transform->make_local_to_world();
+
+			//OBJECT_TO_CLIP takes vertices from object space to clip space:
+			if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
+				glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world);
+				glUniformMatrix4fv(pipeline.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip));
+			}
+
+			//the object-to-light matrix is used in the next two uniforms:
+			glm::mat4x3 object_to_light = world_to_light * glm::mat4(object_to_world);
+
+			//OBJECT_TO_CLIP takes vertices from object space to light space:
+			if (pipeline.OBJECT_TO_LIGHT_mat4x3 != -1U) {
+				glUniformMatrix4x3fv(pipeline.OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(object_to_light));
+			}
+
+			//NORMAL_TO_CLIP takes normals from object space to light space:
+			if (pipeline.NORMAL_TO_LIGHT_mat3 != -1U) {
+				glm::mat3 normal_to_light = glm::inverse(glm::transpose(glm::mat3(object_to_light)));
+				glUniformMatrix3fv(pipeline.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(normal_to_light));
+			}
+
+			//set any requested custom uniforms:
+			set_uniforms(drawable.pipeline, uniform_arena);
+		}
 
 		//set up textures:
+		// (texture 0 means "nothing bound", so a previous drawable's texture is un-bound if this drawable doesn't use that unit)
 		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
+			Drawable::Pipeline::TextureInfo const &want = command.textures[i];
+			Drawable::Pipeline::TextureInfo &have = bound_textures[i];
+			if (want.texture != 0) draw_stats.state_changes_elided += 2 * draw.count;
+			if (want.texture == have.texture && (want.texture == 0 || want.target == have.target)) continue;
+
+			if (active_texture != i) {
 				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, pipeline.textures[i].texture);
+				active_texture = i;
+			}
+			if (want.texture != 0) {
+				if (have.texture != 0 && have.target != want.target) {
+					glBindTexture(have.target, 0);
+					draw_stats.state_changes += 1;
+				}
+				glBindTexture(want.target, want.texture);
+				have = want;
+			} else {
+				glBindTexture(have.target, 0);
+				have.texture = 0;
 			}
+			draw_stats.state_changes += 1;
 		}
 
-		//draw the object:
-		glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
-
-		//un-bind textures:
-		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, 0);
+		//draw the object(s):
+		GLenum type = (draw.lod == 0 ? command.type : command.lods[draw.lod - 1].type);
+		GLuint start = (draw.lod == 0 ? command.start : command.lods[draw.lod - 1].start);
+		GLuint count = (draw.lod == 0 ? command.count : command.lods[draw.lod - 1].count);
+		draw_stats.vertices += uint64_t(count) * draw.count;
+		if (command.index_type != GL_NONE) {
+			GLint base_vertex = (draw.lod == 0 ? command.base_vertex : command.lods[draw.lod - 1].base_vertex);
+			size_t index_size = (command.index_type == GL_UNSIGNED_BYTE ? 1 : command.index_type == GL_UNSIGNED_SHORT ? 2 : 4);
+			void const *offset = reinterpret_cast< void const * >(start * index_size); //(offset in the element array buffer)
+			if (draw.count > 1) {
+				glDrawElementsInstancedBaseVertex(type, count, command.index_type, offset, draw.count, base_vertex);
+			} else {
+				glDrawElementsBaseVertex(type, count, command.index_type, offset, base_vertex);
 			}
+		} else if (draw.count > 1) {
+			glDrawArraysInstanced(type, start, count, draw.count);
+		} else {
+			glDrawArrays(type, start, count);
 		}
-		glActiveTexture(GL_TEXTURE0);
+	}
+	draw_stats.state_changes_elided -= draw_stats.state_changes;
 
+	//leave textures, program, and vertex array un-bound:
+	for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+		if (bound_textures[i].texture != 0) {
+			glActiveTexture(GL_TEXTURE0 + i);
+			glBindTexture(bound_textures[i].target, 0);
+		}
 	}
+	std::vector< uint32_t > buffer_units;
+	if (!slots.empty()) buffer_units.insert(buffer_units.end(), {Drawable::Pipeline::InstancesTextureUnit, Drawable::Pipeline::InstanceSlotsTextureUnit});
+	if (lit) buffer_units.insert(buffer_units.end(), {Drawable::Pipeline::LightsTextureUnit, Drawable::Pipeline::LightRangesTextureUnit, Drawable::Pipeline::LightIndicesTextureUnit});
+	for (uint32_t unit : buffer_units) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+	glActiveTexture(GL_TEXTURE0);
 
 	glUseProgram(0);
 	glBindVertexArray(0);
@@ -166,122 +1591,193 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 }
 
 
+//(lets load_extra read the rest of a mapped file as a stream, without copying it)
+struct MemoryStreambuf : std::streambuf {
+	MemoryStreambuf(char const *begin, char const *end) {
+		//(std::streambuf wants non-const pointers, but never writes through the get area)
+		setg(const_cast< char * >(begin), const_cast< char * >(begin), const_cast< char * >(end));
+	}
+};
+
 void Scene::load(std::string const &filename,
 	std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable) {
+	std::unique_ptr< LoadBatch > batch = parse(filename);
+	commit(*batch, on_drawable);
+}
 
-	std::ifstream file(filename, std::ios::binary);
-
-	std::vector< char > names;
-	read_chunk(file, "str0", &names);
+std::unique_ptr< Scene::LoadBatch > Scene::parse(std::string const &filename) {
+	std::unique_ptr< LoadBatch > batch(new LoadBatch);
+	batch->filename = filename;
+
+	//chunks are read in place from the mapped file (and only copied, one entry at a time, while making objects):
+	batch->file.reset(new MappedFile(filename));
+	MappedFile const &file = *batch->file;
+	char const *at = file.begin();
+
+	static_assert(sizeof(LoadBatch::HierarchyEntry) == 4 + 4 + 4 + 4*3 + 4*4 + 4*3, "HierarchyEntry is packed.");
+	static_assert(sizeof(LoadBatch::MeshEntry) == 4 + 4 + 4, "MeshEntry is packed.");
+	static_assert(sizeof(LoadBatch::CameraEntry) == 4 + 4 + 4 + 4 + 4, "CameraEntry is packed.");
+	static_assert(sizeof(LoadBatch::LightEntry) == 4 + 1 + 3 + 4 + 4 + 4, "LightEntry is packed.");
+	static_assert(sizeof(LoadBatch::TrackEntry) == 4 + 1 + 3 + 4 + 4, "TrackEntry is packed.");
+	static_assert(sizeof(LoadBatch::KeyEntry) == 4 + 4*4, "KeyEntry is packed.");
+
+	batch->names = read_chunk< char >(&at, file.end(), "str0");
+	batch->hierarchy = read_chunk< LoadBatch::HierarchyEntry >(&at, file.end(), "xfh0");
+	batch->meshes = read_chunk< LoadBatch::MeshEntry >(&at, file.end(), "msh0");
+	batch->cameras = read_chunk< LoadBatch::CameraEntry >(&at, file.end(), "cam0");
+	//lights are in "lmp1" chunks if they have cutoff distances; older "lmp0" chunks store Blender's falloff
+	// distance, which isn't a cutoff, so lights from those reach everywhere:
+	if (file.end() - at >= 4 && std::string(at, 4) == "lmp1") {
+		batch->lights = read_chunk< LoadBatch::LightEntry >(&at, file.end(), "lmp1");
+		batch->light_cutoffs = true;
+	} else {
+		batch->lights = read_chunk< LoadBatch::LightEntry >(&at, file.end(), "lmp0");
+	}
+	//animation chunks are optional (older files end -- or go on to extras -- after the lights):
+	if (file.end() - at >= 4 && std::string(at, 4) == "trk0") {
+		batch->tracks = read_chunk< LoadBatch::TrackEntry >(&at, file.end(), "trk0");
+		batch->keys = read_chunk< LoadBatch::KeyEntry >(&at, file.end(), "key0");
+	}
+	batch->extra = at;
 
-	struct HierarchyEntry {
-		uint32_t parent;
-		uint32_t name_begin;
-		uint32_t name_end;
-		glm::vec3 position;
-		glm::quat rotation;
-		glm::vec3 scale;
-	};
-	static_assert(sizeof(HierarchyEntry) == 4 + 4 + 4 + 4*3 + 4*4 + 4*3, "HierarchyEntry is packed.");
-	std::vector< HierarchyEntry > hierarchy;
-	read_chunk(file, "xfh0", &hierarchy);
-
-	struct MeshEntry {
-		uint32_t transform;
-		uint32_t name_begin;
-		uint32_t name_end;
-	};
-	static_assert(sizeof(MeshEntry) == 4 + 4 + 4, "MeshEntry is packed.");
-	std::vector< MeshEntry > meshes;
-	read_chunk(file, "msh0", &meshes);
-
-	struct CameraEntry {
-		uint32_t transform;
-		char type[4]; //"pers" or "orth"
-		float data; //fov in degrees for 'pers', scale for 'orth'
-		float clip_near, clip_far;
+	//check indices, so commit() can trust them:
+	auto check_name = [&](uint32_t name_begin, uint32_t name_end, char const *what) {
+		if (!(name_begin <= name_end && name_end <= batch->names.size())) {
+			throw std::runtime_error("scene file '" + filename + "' contains " + what + " entry with invalid name indices");
+		}
 	};
-	static_assert(sizeof(CameraEntry) == 4 + 4 + 4 + 4 + 4, "CameraEntry is packed.");
-	std::vector< CameraEntry > cameras;
-	read_chunk(file, "cam0", &cameras);
-
-	struct LightEntry {
-		uint32_t transform;
-		char type;
-		glm::u8vec3 color;
-		float energy;
-		float distance;
-		float fov;
+	auto check_transform = [&](uint32_t transform, char const *what) {
+		if (transform >= batch->hierarchy.size()) {
+			throw std::runtime_error("scene file '" + filename + "' contains " + what + " entry with invalid transform index (" + std::to_string(transform) + ")");
+		}
 	};
-	static_assert(sizeof(LightEntry) == 4 + 1 + 3 + 4 + 4 + 4, "LightEntry is packed.");
-	std::vector< LightEntry > lights;
-	read_chunk(file, "lmp0", &lights);
 
+	for (size_t i = 0; i < batch->hierarchy.size(); ++i) {
+		LoadBatch::HierarchyEntry const h = batch->hierarchy[i];
+		if (h.parent != -1U && h.parent >= i) {
+			throw std::runtime_error("scene file '" + filename + "' did not contain transforms in topological-sort order.");
+		}
+		check_name(h.name_begin, h.name_end, "hierarchy");
+	}
+	for (size_t i = 0; i < batch->meshes.size(); ++i) {
+		LoadBatch::MeshEntry const m = batch->meshes[i];
+		check_transform(m.transform, "mesh");
+		check_name(m.name_begin, m.name_end, "mesh");
+	}
+	for (size_t i = 0; i < batch->cameras.size(); ++i) {
+		check_transform(batch->cameras[i].transform, "camera");
+	}
+	for (size_t i = 0; i < batch->lights.size(); ++i) {
+		check_transform(batch->lights[i].transform, "lamp");
+	}
+	for (size_t i = 0; i < batch->tracks.size(); ++i) {
+		LoadBatch::TrackEntry const t = batch->tracks[i];
+		check_transform(t.transform, "track");
+		if (t.channel != Track::Position && t.channel != Track::Rotation && t.channel != Track::Scale) {
+			throw std::runtime_error("scene file '" + filename + "' contains track entry with unknown channel '" + std::string(&t.channel, 1) + "'");
+		}
+		if (!(t.key_begin < t.key_end && t.key_end <= batch->keys.size())) {
+			throw std::runtime_error("scene file '" + filename + "' contains track entry with invalid key indices");
+		}
+		for (uint32_t k = t.key_begin + 1; k < t.key_end; ++k) {
+			if (!(batch->keys[k-1].time <= batch->keys[k].time)) {
+				throw std::runtime_error("scene file '" + filename + "' contains track with keys out of time order");
+			}
+		}
+	}
 
-	//--------------------------------
-	//Now that file is loaded, create transforms for hierarchy entries:
+	//touch the rest of the file, so that page faults happen here rather than during commit():
+	// (the checks above have already read the main chunks)
+	uint8_t touched = 0;
+	for (char const *page = at; page < file.end(); page += 4096) {
+		touched ^= *reinterpret_cast< uint8_t const volatile * >(page);
+	}
+	(void)touched;
 
-	std::vector< Transform * > hierarchy_transforms;
-	hierarchy_transforms.reserve(hierarchy.size());
+	return batch;
+}
+
+bool Scene::commit(LoadBatch &batch,
+	std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable,
+	float budget) {
+
+	if (batch.committed) return true;
 
-	for (auto const &h : hierarchy) {
+	auto start = std::chrono::high_resolution_clock::now();
+	//(checked every few objects, since reading the clock isn't free)
+	auto out_of_time = [&]() {
+		return std::chrono::duration< float >(std::chrono::high_resolution_clock::now() - start).count() >= budget;
+	};
+	enum : uint32_t { CheckEvery = 16 };
+	uint32_t made = 0; //objects made by this call (at least one is made per call, so loading always progresses)
+
+	auto name = [&batch](uint32_t name_begin, uint32_t name_end) {
+		return std::string_view(batch.names.data + name_begin, name_end - name_begin);
+	};
+
+	//create transforms for hierarchy entries:
+	if (batch.hierarchy_transforms.empty()) {
+		//(first call -- allocate space up front:)
+		batch.hierarchy_transforms.reserve(batch.hierarchy.size());
+		transforms.reserve(transforms.slots() + uint32_t(batch.hierarchy.size()));
+		//(most meshes end up as drawables)
+		drawables.reserve(drawables.slots() + uint32_t(batch.meshes.size()));
+		this->cameras.reserve(this->cameras.slots() + uint32_t(batch.cameras.size()));
+		this->lights.reserve(this->lights.slots() + uint32_t(batch.lights.size()));
+	}
+	while (batch.hierarchy_transforms.size() < batch.hierarchy.size()) {
+		if (made != 0 && made % CheckEvery == 0 && out_of_time()) return false;
+		made += 1;
+
+		LoadBatch::HierarchyEntry const h = batch.hierarchy[batch.hierarchy_transforms.size()];
 		transforms.emplace_back();
 		Transform *t = &transforms.back();
 		if (h.parent != -1U) {
-			if (h.parent >= hierarchy_transforms.size()) {
-				throw std::runtime_error("scene file '" + filename + "' did not contain transforms in topological-sort order.");
-			}
-			t->parent = hierarchy_transforms[h.parent];
+			t->set_parent(batch.hierarchy_transforms[h.parent]);
 		}
 
-		if (h.name_begin <= h.name_end && h.name_end <= names.size()) {
-			t->name = std::string(names.begin() + h.name_begin, names.begin() + h.name_end);
-		} else {
-				throw std::runtime_error("scene file '" + filename + "' contains hierarchy entry with invalid name indices");
-		}
+		t->name = name(h.name_begin, h.name_end);
 
 		t->position = h.position;
 		t->rotation = h.rotation;
 		t->scale = h.scale;
 
-		hierarchy_transforms.emplace_back(t);
+		batch.hierarchy_transforms.emplace_back(t);
 	}
-	assert(hierarchy_transforms.size() == hierarchy.size());
 
-	for (auto const &m : meshes) {
-		if (m.transform >= hierarchy_transforms.size()) {
-			throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid transform index (" + std::to_string(m.transform) + ")");
-		}
-		if (!(m.name_begin <= m.name_end && m.name_end <= names.size())) {
-			throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid name indices");
-		}
-		std::string name = std::string(names.begin() + m.name_begin, names.begin() + m.name_end);
+	std::string mesh_name; //(reused, so on_drawable calls don't allocate)
+	while (batch.meshes_committed < batch.meshes.size()) {
+		//(on_drawable may be slow, so check after every mesh)
+		if (made != 0 && out_of_time()) return false;
+		made += 1;
+
+		LoadBatch::MeshEntry const m = batch.meshes[batch.meshes_committed];
+		batch.meshes_committed += 1;
+		mesh_name = name(m.name_begin, m.name_end);
 
 		if (on_drawable) {
-			on_drawable(*this, hierarchy_transforms[m.transform], name);
+			on_drawable(*this, batch.hierarchy_transforms[m.transform], mesh_name);
 		}
 
 	}
 
-	for (auto const &c : cameras) {
-		if (c.transform >= hierarchy_transforms.size()) {
-			throw std::runtime_error("scene file '" + filename + "' contains camera entry with invalid transform index (" + std::to_string(c.transform) + ")");
-		}
+	//(cameras, lights, animation tracks, and extras are cheap, so they are added all at once)
+
+	for (size_t i = 0; i < batch.cameras.size(); ++i) {
+		LoadBatch::CameraEntry const c = batch.cameras[i];
 		if (std::string(c.type, 4) != "pers") {
 			std::cout << "Ignoring non-perspective camera (" + std::string(c.type, 4) + ") stored in file." << std::endl;
 			continue;
 		}
-		this->cameras.emplace_back(hierarchy_transforms[c.transform]);
+		this->cameras.emplace_back(batch.hierarchy_transforms[c.transform]);
 		Camera *camera = &this->cameras.back();
 		camera->fovy = c.data / 180.0f * 3.1415926f; //FOV is stored in degrees; convert to radians.
 		camera->near = c.clip_near;
 		//N.b. far plane is ignored because cameras use infinite perspective matrices.
 	}
 
-	for (auto const &l : lights) {
-		if (l.transform >= hierarchy_transforms.size()) {
-			throw std::runtime_error("scene file '" + filename + "' contains lamp entry with invalid transform index (" + std::to_string(l.transform) + ")");
-		}
+	for (size_t i = 0; i < batch.lights.size(); ++i) {
+		LoadBatch::LightEntry const l = batch.lights[i];
 		if (l.type == 'p') {
 			//good
 		} else if (l.type == 'h') {
@@ -294,22 +1790,70 @@ void Scene::load(std::string const &filename,
 			std::cout << "Ignoring unrecognized lamp type (" + std::string(&l.type, 1) + ") stored in file." << std::endl;
 			continue;
 		}
-		this->lights.emplace_back(hierarchy_transforms[l.transform]);
+		this->lights.emplace_back(batch.hierarchy_transforms[l.transform]);
 		Light *light = &this->lights.back();
 		light->type = static_cast<Light::Type>(l.type);
 		light->energy = glm::vec3(l.color) / 255.0f * l.energy;
 		light->spot_fov = l.fov / 180.0f * 3.1415926f; //FOV is stored in degrees; convert to radians.
+		light->distance = (batch.light_cutoffs ? std::max(0.0f, l.distance) : 0.0f);
 	}
 
+	//keys are appended after any that are already in the scene:
+	uint32_t keys_offset = uint32_t(key_times.size());
+	key_times.reserve(key_times.size() + batch.keys.size());
+	key_values.reserve(key_values.size() + batch.keys.size());
+	for (size_t i = 0; i < batch.keys.size(); ++i) {
+		LoadBatch::KeyEntry const k = batch.keys[i];
+		key_times.emplace_back(k.time);
+		key_values.emplace_back(k.value);
+	}
+	tracks.reserve(tracks.size() + batch.tracks.size());
+	for (size_t i = 0; i < batch.tracks.size(); ++i) {
+		LoadBatch::TrackEntry const t = batch.tracks[i];
+		Track track;
+		track.transform = batch.hierarchy_transforms[t.transform];
+		track.channel = static_cast< Track::Channel >(t.channel);
+		track.key_begin = keys_offset + t.key_begin;
+		track.key_end = keys_offset + t.key_end;
+		tracks.emplace_back(track);
+	}
+
+	//index the new transforms' names now, rather than on the first lookup:
+	update_name_index();
+
 	//load any extra that a subclass wants:
-	load_extra(file, names, hierarchy_transforms);
+	MemoryStreambuf rest_buf(batch.extra, batch.file->end());
+	std::istream rest(&rest_buf);
+	load_extra(rest, std::string_view(batch.names.data, batch.names.size()), batch.hierarchy_transforms);
 
-	if (file.peek() != EOF) {
-		std::cerr << "WARNING: trailing data in scene file '" << filename << "'" << std::endl;
+	if (rest.peek() != EOF) {
+		std::cerr << "WARNING: trailing data in scene file '" << batch.filename << "'" << std::endl;
 	}
 
+	batch.committed = true;
+	return true;
+}
 
+Scene::Streaming::Streaming(std::string const &filename) {
+	parsing = std::async(std::launch::async, &Scene::parse, filename);
+}
 
+bool Scene::Streaming::update(Scene *scene,
+	std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable,
+	float budget) {
+	assert(scene);
+	if (!batch) {
+		if (failure) std::rethrow_exception(failure); //(parse() failed during an earlier update)
+		if (parsing.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return false;
+		try {
+			batch = parsing.get();
+		} catch (...) {
+			//(get() leaves 'parsing' without a result, so remember the failure for later updates)
+			failure = std::current_exception();
+			throw;
+		}
+	}
+	return scene->commit(*batch, on_drawable, budget);
 }
 
 //-------------------------
@@ -327,51 +1871,214 @@ Scene &Scene::operator=(Scene const &other) {
 	return *this;
 }
 
-void Scene::set(Scene const &other, std::unordered_map< Transform const *, Transform * > *transform_map_) {
-
-	std::unordered_map< Transform const *, Transform * > t2t_temp;
-	std::unordered_map< Transform const *, Transform * > &transform_to_transform = *(transform_map_ ? transform_map_ : &t2t_temp);
-
-	transform_to_transform.clear();
+void Scene::set(Scene const &other, std::unordered_map< Transform const *, Transform * > *transform_map) {
 
-	//null transform maps to itself:
-	transform_to_transform.insert(std::make_pair(nullptr, nullptr));
+	if (&other == this) return;
 
-	//Copy transforms and store mapping:
+	//Copy transforms into the same pool slots as in other:
+	// (so a transform's slot index identifies it in both scenes)
 	transforms.clear();
-	for (auto const &t : other.transforms) {
-		transforms.emplace_back();
-		transforms.back().name = t.name;
-		transforms.back().position = t.position;
-		transforms.back().rotation = t.rotation;
-		transforms.back().scale = t.scale;
-		transforms.back().parent = t.parent; //will update later
-
-		//store mapping between transforms old and new:
-		auto ret = transform_to_transform.insert(std::make_pair(&t, &transforms.back()));
-		assert(ret.second);
+	transforms.reserve(other.transforms.slots());
+	for (uint32_t i = 0; i < other.transforms.slots(); ++i) {
+		Transform &t = transforms.emplace_back();
+		if (!other.transforms.occupied(i)) continue;
+		Transform const &o = other.transforms.at_index(i);
+		t.name = o.name;
+		t.position = o.position;
+		t.rotation = o.rotation;
+		t.scale = o.scale;
 	}
 
-	//update transform parents:
-	for (auto &t : transforms) {
-		t.parent = transform_to_transform.at(t.parent);
+	//other's transform -> this scene's transform:
+	auto remap = [&](Transform const *t) -> Transform * {
+		if (t == nullptr) return nullptr;
+		uint32_t i = other.transforms.index(t);
+		if (i == -1U) throw std::runtime_error("Scene::set: object refers to a transform that isn't part of the scene.");
+		return &transforms.at_index(i);
+	};
+
+	//update transform parents (and free slots that were empty in other):
+	for (uint32_t i = 0; i < other.transforms.slots(); ++i) {
+		if (!other.transforms.occupied(i)) {
+			transforms.erase(&transforms.at_index(i));
+		} else if (Transform const *parent = other.transforms.at_index(i).parent) {
+			transforms.at_index(i).set_parent(remap(parent));
+		}
 	}
 
 	//copy other's drawables, updating transform pointers:
 	drawables = other.drawables;
 	for (auto &d : drawables) {
-		d.transform = transform_to_transform.at(d.transform);
+		d.transform = remap(d.transform);
 	}
 
 	//copy other's cameras, updating transform pointers:
 	cameras = other.cameras;
 	for (auto &c : cameras) {
-		c.transform = transform_to_transform.at(c.transform);
+		c.transform = remap(c.transform);
 	}
 
 	//copy other's lights, updating transform pointers:
 	lights = other.lights;
 	for (auto &l : lights) {
-		l.transform = transform_to_transform.at(l.transform);
+		l.transform = remap(l.transform);
+	}
+
+	//copy other's animation tracks, updating transform pointers:
+	tracks = other.tracks;
+	for (auto &t : tracks) {
+		t.transform = remap(t.transform);
+	}
+	key_times = other.key_times;
+	key_values = other.key_values;
+	prefab_keys = other.prefab_keys;
+
+	//copy other's uniform values:
+	uniform_arena = other.uniform_arena;
+	prefab_uniform_arenas = other.prefab_uniform_arenas;
+
+	//copy other's occlusion culling settings:
+	occluder_screen_size = other.occluder_screen_size;
+	max_occluders = other.max_occluders;
+
+	//index the copied transforms' names:
+	update_name_index();
+
+	//build the transform->transform map if the caller asked for it:
+	if (transform_map) {
+		transform_map->clear();
+		transform_map->reserve(other.transforms.size() + 1);
+		transform_map->insert(std::make_pair(nullptr, nullptr));
+		for (auto const &o : other.transforms) {
+			transform_map->insert(std::make_pair(&o, remap(&o)));
+		}
+	}
+}
+
+//-------------------------
+
+Scene::Prefab::Prefab(Scene const &scene) {
+	//number transforms so that parents come before children (roots in slot order, then depth-first):
+	std::unordered_map< Transform const *, uint32_t > node_of;
+	node_of.reserve(scene.transforms.size());
+	nodes.reserve(scene.transforms.size());
+	names.reserve(scene.transforms.size());
+	std::vector< Transform const * > stack;
+	for (auto const &root : scene.transforms) {
+		if (root.parent) continue;
+		stack.emplace_back(&root);
+		while (!stack.empty()) {
+			Transform const *t = stack.back();
+			stack.pop_back();
+			uint32_t index = uint32_t(nodes.size());
+			node_of.emplace(t, index);
+			nodes.emplace_back(Node{
+				t->parent ? node_of.at(t->parent) : -1U,
+				t->position, t->rotation, t->scale
+			});
+			names.emplace_back(t->name);
+			node_index.emplace(t->name, index); //(keeps the first node with each name)
+			for (Transform const *child = t->first_child; child; child = child->next_sibling) {
+				stack.emplace_back(child);
+			}
+		}
+	}
+
+	auto node = [&](Transform const *t) {
+		auto f = node_of.find(t);
+		if (f == node_of.end()) throw std::runtime_error("Scene::Prefab: object refers to a transform that isn't part of the scene.");
+		return f->second;
+	};
+
+	drawables.reserve(scene.drawables.size());
+	for (auto const &d : scene.drawables) {
+		drawable_nodes.emplace_back(node(d.transform));
+		drawables.emplace_back(d);
+		drawables.back().transform = nullptr;
+	}
+	for (auto const &l : scene.lights) {
+		light_nodes.emplace_back(node(l.transform));
+		lights.emplace_back(l);
+		lights.back().transform = nullptr;
+	}
+	for (auto const &t : scene.tracks) {
+		track_nodes.emplace_back(node(t.transform));
+		tracks.emplace_back(t);
+		tracks.back().transform = nullptr;
+	}
+
+	std::shared_ptr< Keys > shared_keys = std::make_shared< Keys >();
+	shared_keys->times = scene.key_times;
+	shared_keys->values = scene.key_values;
+	keys = shared_keys;
+
+	uniform_arena = std::make_shared< std::vector< float > const >(scene.uniform_arena);
+}
+
+uint32_t Scene::Prefab::find_node(std::string_view name) const {
+	auto f = node_index.find(name);
+	return (f == node_index.end() ? -1U : f->second);
+}
+
+void Scene::spawn(Prefab const &prefab, Transform *parent, std::vector< Transform * > *spawned_) {
+	std::vector< Transform * > local;
+	std::vector< Transform * > &spawned = (spawned_ ? *spawned_ : local);
+	spawned.clear();
+	spawned.reserve(prefab.nodes.size());
+
+	for (uint32_t i = 0; i < uint32_t(prefab.nodes.size()); ++i) {
+		Prefab::Node const &n = prefab.nodes[i];
+		Transform &t = transforms.emplace();
+		t.name = prefab.names[i];
+		t.position = n.position;
+		t.rotation = n.rotation;
+		t.scale = n.scale;
+		t.set_parent(n.parent != -1U ? spawned[n.parent] : parent);
+		spawned.emplace_back(&t);
+	}
+
+	//add the prefab's uniform_arena values the first time one of its instances that uses them is spawned here:
+	uint32_t arena_offset = -1U;
+	auto get_arena_offset = [&]() {
+		if (arena_offset != -1U) return arena_offset;
+		auto f = std::find_if(prefab_uniform_arenas.begin(), prefab_uniform_arenas.end(), [&](auto const &pa) { return pa.first == prefab.uniform_arena; });
+		if (f == prefab_uniform_arenas.end()) {
+			prefab_uniform_arenas.emplace_back(prefab.uniform_arena, uint32_t(uniform_arena.size()));
+			uniform_arena.insert(uniform_arena.end(), prefab.uniform_arena->begin(), prefab.uniform_arena->end());
+			f = prefab_uniform_arenas.end() - 1;
+		}
+		arena_offset = f->second;
+		return arena_offset;
+	};
+
+	for (uint32_t i = 0; i < uint32_t(prefab.drawables.size()); ++i) {
+		Drawable &d = drawables.emplace(prefab.drawables[i]);
+		d.transform = spawned[prefab.drawable_nodes[i]];
+		for (auto &uniform : d.pipeline.uniforms) {
+			if (uniform.location != -1U && uniform.offset != -1U) uniform.offset += get_arena_offset();
+		}
+	}
+	for (uint32_t i = 0; i < uint32_t(prefab.lights.size()); ++i) {
+		Light &l = lights.emplace(prefab.lights[i]);
+		l.transform = spawned[prefab.light_nodes[i]];
+	}
+
+	if (!prefab.tracks.empty()) {
+		//add the prefab's keys the first time one of its instances is spawned here:
+		auto f = std::find_if(prefab_keys.begin(), prefab_keys.end(), [&](auto const &pk) { return pk.first == prefab.keys; });
+		if (f == prefab_keys.end()) {
+			prefab_keys.emplace_back(prefab.keys, uint32_t(key_times.size()));
+			key_times.insert(key_times.end(), prefab.keys->times.begin(), prefab.keys->times.end());
+			key_values.insert(key_values.end(), prefab.keys->values.begin(), prefab.keys->values.end());
+			f = prefab_keys.end() - 1;
+		}
+		uint32_t keys_offset = f->second;
+		for (uint32_t i = 0; i < uint32_t(prefab.tracks.size()); ++i) {
+			Track track = prefab.tracks[i];
+			track.transform = spawned[prefab.track_nodes[i]];
+			track.key_begin += keys_offset;
+			track.key_end += keys_offset;
+			tracks.emplace_back(track);
+		}
 	}
 }
@@ -11,21 +11,36 @@
  */
 
 #include "GL.hpp"
+#include "Pool.hpp"
+#include "BVH.hpp"
+#include "LightClusters.hpp"
+#include "OcclusionBuffer.hpp"
+#include "MappedFile.hpp"
+#include "read_write_chunk.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
 #include <list>
+#include <map>
+#include <atomic>
+#include <exception>
 #include <memory>
 #include <functional>
+#include <future>
+#include <limits>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <unordered_map>
 
 struct Scene {
+	struct MovedList;
 	struct Transform {
 		//Transform names are useful for debugging and looking up locations in a loaded scene:
+		// (see Scene::find_transform; use set_name() to rename, so that the name index stays in sync)
 		std::string name;
+		void set_name(std::string const &);
 
 		//The core function of a transform is to store a transformation in the world:
 		glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
@@ -33,20 +48,64 @@ struct Scene {
 		glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f);
 
 		//The transform above may be relative to some parent transform:
+		// (use set_parent() to change this, so that child links stay in sync)
 		Transform *parent = nullptr;
 
+		//World-relative matrices are cached, so changes must be reported:
+		// these helpers update the value and mark this transform (and its descendants) dirty:
+		void set_position(glm::vec3 const &);
+		void set_rotation(glm::quat const &);
+		void set_scale(glm::vec3 const &);
+		void set_parent(Transform *);
+		// ..if you write position/rotation/scale directly, call this afterward:
+		void mark_dirty();
+
 		//It is often convenient to construct matrices representing this transformation:
 		// ..relative to its parent:
 		glm::mat4x3 make_local_to_parent() const;
 		glm::mat4x3 make_parent_to_local() const;
-		// ..relative to the world:
+		// ..(same computation as make_local_to_parent, for values stored elsewhere -- e.g., in a TransformHierarchy):
+		static glm::mat4x3 make_local_to_parent(glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale);
+		// ..relative to the world (cached; only recomputed when this transform or an ancestor is dirty):
 		glm::mat4x3 make_local_to_world() const;
 		glm::mat4x3 make_world_to_local() const;
+		// ..(the same, for many transforms at once, using vector instructions where available -- results are identical):
+		// brings every listed transform (and any dirty ancestors) up to date; uses the list as scratch and leaves it empty
+		static void update_local_to_world(std::vector< Transform const * > *transforms);
+		// ..(the kernel behind update_local_to_world, for values stored elsewhere -- e.g., in a TransformHierarchy):
+		// local_to_world[i] = *parents[i] * mat4(make_local_to_parent(...)), or just make_local_to_parent(...) if parents[i] is null
+		// (parents must not point into local_to_world[0,count); work is done in batches of KernelWidth transforms)
+		enum : uint32_t { KernelWidth = 8 };
+		static void compute_local_to_world(uint32_t count, glm::vec3 const *positions, glm::quat const *rotations, glm::vec3 const *scales, glm::mat4x3 const * const *parents, glm::mat4x3 *local_to_world);
+
+		//Children are tracked as an intrusive list (maintained by set_parent):
+		Transform *first_child = nullptr;
+		Transform *next_sibling = nullptr;
+
+		//Cached world-relative matrices:
+		// invariant: if a transform's cache is dirty, so are the caches of all of its descendants
+		mutable glm::mat4x3 local_to_world = glm::mat4x3(1.0f);
+		mutable glm::mat4x3 world_to_local = glm::mat4x3(1.0f);
+		mutable bool local_to_world_dirty = true;
+		mutable bool world_to_local_dirty = true;
+		//incremented whenever local_to_world is recomputed (so other structures can tell when it has changed):
+		mutable uint32_t local_to_world_revision = 0;
+		//incremented whenever any transform (in any scene) becomes dirty:
+		// (so structures derived from many transforms can cheaply tell that nothing has moved)
+		static std::atomic< uint32_t > changes;
+		//incremented whenever any transform (in any scene) is renamed with set_name():
+		static std::atomic< uint32_t > renames;
+		//(if set) this transform is added to this list whenever it moves:
+		// (set by the scene whose draw list or drawables hierarchy uses this transform, so they only have to look at transforms that moved)
+		mutable std::shared_ptr< MovedList > moved_list;
+		void report_moved() const;
 
 		//since hierarchy is tracked through pointers, copy-constructing a transform  is not advised:
 		Transform(Transform const &) = delete;
 		//if we delete some constructors, we need to let the compiler know that the default constructor is still okay:
 		Transform() = default;
+		//destroying a transform unlinks it from its parent and orphans its children:
+		~Transform();
 	};
 
 	struct Drawable {
@@ -54,6 +113,45 @@ struct Scene {
 		Drawable(Transform *transform_) : transform(transform_) { assert(transform); }
 		Transform * transform;
 
+		//Bounding box of the drawable's vertices, relative to its transform:
+		// used by draw() to skip drawables that are entirely outside the view frustum
+		// (the default, empty box means "bounds unknown"; such drawables are never culled)
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+		bool has_bounds() const { return min.x <= max.x; }
+		//the drawables hierarchy (see find_visible_drawables) is built from bounds, so changes must be reported:
+		// this helper updates the value and marks the hierarchy for refitting:
+		void set_bounds(glm::vec3 const &min, glm::vec3 const &max);
+		// ..if you write min/max directly, call this afterward:
+		void mark_bounds_changed();
+		//incremented whenever any drawable (in any scene) reports changed bounds (or a changed transform pointer):
+		static std::atomic< uint32_t > bounds_changes;
+		//is the bounding box entirely outside the clip volume? (always false without bounds)
+		bool outside(glm::mat4 const &object_to_clip) const;
+
+		//(optional) box, relative to transform, that the drawable's surface entirely hides -- e.g., the bounds of a solid,
+		// box-like building or wall -- used by draw() to skip other drawables behind it (see "Occlusion culling" below)
+		// (the default, empty box means "not an occluder")
+		glm::vec3 occluder_min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 occluder_max = glm::vec3(-std::numeric_limits< float >::infinity());
+		bool is_occluder() const { return occluder_min.x <= occluder_max.x; }
+
+		//(optional) simpler versions of the mesh, drawn in place of pipeline.type/start/count when the drawable is small on screen:
+		// lods[i] ("LOD i+1") is used once the drawable's screen size -- the fraction of the view's height covered by its
+		//  bounding sphere -- drops below lods[i].screen_size; sizes should decrease along the chain, which ends at the first
+		//  entry with count == 0. Switching is delayed by a margin (LODHysteresis) around each threshold, to avoid popping.
+		// (lods only apply to drawables with bounds; all of a drawable's LODs are drawn with the same vao)
+		enum : uint32_t { LODCount = 4 };
+		struct LOD {
+			GLenum type = GL_TRIANGLES;
+			GLuint start = 0;
+			GLuint count = 0;
+			float screen_size = 0.0f;
+			GLint base_vertex = 0; //(for indexed drawing; LODs use the pipeline's index_type)
+		} lods[LODCount];
+		static constexpr float LODHysteresis = 0.1f; //(fraction of a threshold)
+		mutable uint8_t lod = 0; //level drawn most recently (0 is the pipeline's own vertices)
+
 		//Contains all the data needed to run the OpenGL pipeline:
 		struct Pipeline {
 			GLuint program = 0; //shader program; passed to glUseProgram
@@ -62,15 +160,62 @@ struct Scene {
 			GLuint vao = 0; //attrib->buffer mapping; passed to glBindVertexArray
 
 			GLenum type = GL_TRIANGLES; //what sort of primitive to draw; passed to glDrawArrays
-			GLuint start = 0; //first vertex to draw; passed to glDrawArrays
-			GLuint count = 0; //number of vertices to draw; passed to glDrawArrays
+			GLuint start = 0; //first vertex to draw; passed to glDrawArrays (for indexed drawing: first index)
+			GLuint count = 0; //number of vertices to draw; passed to glDrawArrays (for indexed drawing: number of indices)
+
+			//indexed drawing, from the element array buffer bound in vao (see MeshBuffer):
+			GLenum index_type = GL_NONE; //GL_UNSIGNED_BYTE/SHORT/INT to draw with glDrawElementsBaseVertex; GL_NONE for glDrawArrays
+			GLint base_vertex = 0; //added to each index
 
 			//uniforms:
 			GLuint OBJECT_TO_CLIP_mat4 = -1U; //uniform location for object to clip space matrix
 			GLuint OBJECT_TO_LIGHT_mat4x3 = -1U; //uniform location for object to light space (== world space) matrix
 			GLuint NORMAL_TO_LIGHT_mat3 = -1U; //uniform location for normal to light space (== world space) matrix
 
-			std::function< void() > set_uniforms; //(optional) function to set any other useful uniforms
+			//(optional) other useful uniforms, as plain data, so that pipelines can be copied with memcpy:
+			// entries with location -1U are unused
+			// Int, Float, and Vec* values are stored inline; matrices (and any value with an 'offset') are read
+			//  from Scene::uniform_arena, starting at float number 'offset' -- so per-frame values can be updated
+			//  there without touching drawables
+			enum : uint32_t { UniformCount = 4 };
+			struct UniformInfo {
+				GLuint location = -1U;
+				enum Type : uint8_t {
+					Int, Float, Vec2, Vec3, Vec4, //one value (inline or in the arena)
+					Mat3, Mat4x3, Mat4 //'count' values, in the arena (column-major, like glm)
+				} type = Float;
+				uint32_t offset = -1U; //offset (in floats) of the value in Scene::uniform_arena, or -1U for inline values
+				uint32_t count = 1; //number of array elements (arena values only)
+				union {
+					float floats[4];
+					GLint ints[4];
+				} value = {{0.0f, 0.0f, 0.0f, 0.0f}};
+			} uniforms[UniformCount];
+			bool has_uniforms() const;
+			//helpers that fill in the first unused entry of 'uniforms' (and throw if there is none):
+			void add_uniform(GLuint location, GLint value);
+			void add_uniform(GLuint location, float value);
+			void add_uniform(GLuint location, glm::vec2 const &value);
+			void add_uniform(GLuint location, glm::vec3 const &value);
+			void add_uniform(GLuint location, glm::vec4 const &value);
+			void add_arena_uniform(GLuint location, UniformInfo::Type type, uint32_t offset, uint32_t count = 1);
+
+			//(optional) a version of 'program' that draws many copies of the same vertices at once:
+			// if set (and 'uniforms' is empty), draw() uses it in place of 'program': every such drawable has a slot in a
+			//  buffer of object-to-world matrices (only updated when its transform moves), and groups of drawables whose
+			//  pipelines differ only by transform are drawn with a single instanced call
+			// instead of the three matrix uniforms above, it uses per-frame uniforms WORLD_TO_CLIP and WORLD_TO_LIGHT, and
+			//  finds instance number gl_InstanceID's matrices by reading its slot from a buffer texture (usamplerBuffer, R32UI)
+			//  bound to unit InstanceSlotsTextureUnit at texel INSTANCE_FIRST + gl_InstanceID, then reading texels
+			//  slot * InstanceTexels + (0-5) of a buffer texture (samplerBuffer, RGBA32F) bound to unit InstancesTextureUnit:
+			//   texels 0-2: OBJECT_TO_WORLD rows
+			//   texels 3-5: NORMAL_TO_WORLD columns (in xyz)
+			// its attribute locations must match those of 'program', so that it can use the same vao
+			GLuint instanced_program = 0;
+			GLuint INSTANCE_FIRST_int = -1U; //uniform location (in instanced_program) for index of first instance's slot
+			GLuint WORLD_TO_CLIP_mat4 = -1U; //uniform location (in instanced_program) for world to clip space matrix
+			GLuint WORLD_TO_LIGHT_mat4x3 = -1U; //uniform location (in instanced_program) for world to light space matrix
+			enum : uint32_t { InstanceTexels = 6 };
 
 			//texture objects to bind for the first TextureCount textures:
 			enum : uint32_t { TextureCount = 4 };
@@ -78,7 +223,32 @@ struct Scene {
 				GLuint texture = 0;
 				GLenum target = GL_TEXTURE_2D;
 			} textures[TextureCount];
+
+			//does 'program' (and instanced_program) shade with the scene's lights?
+			// if so, draw() bins lights into clusters (see LightClusters.hpp) and binds buffer textures holding:
+			//  LightsTextureUnit: LightClusters::lights_data (RGBA32F)
+			//  LightRangesTextureUnit: LightClusters::ranges (RG32UI)
+			//  LightIndicesTextureUnit: LightClusters::indices (R32UI)
+			bool uses_lights = false;
+
+			//texture units used by draw() for buffer textures (after the units used for 'textures'):
+			enum : uint32_t {
+				InstancesTextureUnit = TextureCount,
+				LightsTextureUnit = TextureCount + 1,
+				LightRangesTextureUnit = TextureCount + 2,
+				LightIndicesTextureUnit = TextureCount + 3,
+				InstanceSlotsTextureUnit = TextureCount + 4,
+			};
 		} pipeline;
+
+		//draw() works from a list compiled from drawables' transform pointers, pipelines, and lods, so changes must be reported:
+		// these helpers update the value and mark the draw list for rebuilding (set_transform also marks the hierarchy for refitting):
+		void set_transform(Transform *);
+		void set_pipeline(Pipeline const &);
+		// ..if you write transform, pipeline, or lods directly, call this afterward:
+		void mark_pipeline_changed();
+		//incremented whenever any drawable (in any scene) reports a change with the above:
+		static std::atomic< uint32_t > pipeline_changes;
 	};
 
 	struct Camera {
@@ -114,30 +284,397 @@ struct Scene {
 
 		//Spotlight specific:
 		float spot_fov = glm::radians(45.0f); //spot cone fov (in radians)
+
+		//Point and spot lights have no effect beyond this distance (0 means they reach everywhere):
+		// (lights with a distance only need to be considered for nearby pixels, so are much cheaper)
+		// (loaded from Blender's Eevee "Custom Distance" cutoff, if it was set -- not from the light's
+		//  falloff 'distance', which isn't a cutoff)
+		float distance = 0.0f;
+	};
+
+	//Transforms that have moved, for structures derived from them to catch up on without checking every transform:
+	// (only transforms whose moved_list is set are added -- see Transform::moved_list -- so a transform is only
+	//  watched by one scene at a time; if two scenes' drawables share a transform, they end up checking everything)
+	struct MovedList {
+		//transforms, appended as they move (used only as keys -- these may have since been destroyed):
+		std::vector< Transform const * > transforms;
+		//instead of growing past 'limit', the list is abandoned and 'overflowed' is set:
+		// (the limit grows with the number of transforms watched)
+		uint32_t limit = 64;
+		bool overflowed = false;
+		uint32_t epoch = 0; //incremented whenever an overflowed list is cleared
+		void add(Transform const *transform) {
+			if (transforms.size() < limit) transforms.emplace_back(transform);
+			else overflowed = true;
+		}
+		//how far a structure has gotten through the list:
+		struct Reader {
+			uint32_t read = 0; //entries before this one have been seen
+			uint32_t epoch = -1U; //(if this isn't the list's epoch, the reader missed some entries)
+		};
 	};
+	mutable std::shared_ptr< MovedList > moved_transforms = std::make_shared< MovedList >();
+	//start watching a transform (if another scene was watching it, that scene will check everything on its next look):
+	void watch_transform(Transform const *transform) const;
+	//the entries of moved_transforms a reader hasn't seen, as [*begin,*end) -- or false if it must check everything:
+	// (*begin and *end are only valid until the next call to trim_moved_transforms())
+	bool read_moved_transforms(MovedList::Reader *reader, uint32_t *begin, uint32_t *end) const;
+	//mark a reader as having seen everything so far (e.g., after checking everything):
+	void sync_moved_transforms(MovedList::Reader *reader) const;
+	//clear the list once every reader has seen all of it:
+	void trim_moved_transforms() const;
+	//transforms whose world matrices are about to be needed, for Transform::update_local_to_world to compute together:
+	// (kept between updates to re-use allocations)
+	mutable std::vector< Transform const * > stale_transforms;
 
 	//Scenes, of course, may have many of the above objects:
-	std::list< Transform > transforms;
-	std::list< Drawable > drawables;
-	std::list< Camera > cameras;
-	std::list< Light > lights;
+	// (pools keep objects at stable addresses, like lists, but allocate and iterate in chunks)
+	Pool< Transform > transforms;
+	Pool< Drawable > drawables;
+	Pool< Camera > cameras;
+	Pool< Light > lights;
+
+	//Keyframe animation (loaded from the scene file, if it has any), played back by an AnimationSampler:
+	// each track moves one channel of one transform through a run of keys in key_times/key_values
+	struct Track {
+		Transform *transform;
+		enum Channel : char {
+			Position = 'p',
+			Rotation = 'r',
+			Scale = 's'
+		} channel = Position;
+		uint32_t key_begin = 0, key_end = 0; //keys [key_begin,key_end), in increasing time order
+	};
+	std::vector< Track > tracks;
+	std::vector< float > key_times; //seconds
+	std::vector< glm::vec4 > key_values; //xyz for position and scale; xyzw for rotation
+
+	//values for drawables' arena uniforms (see Drawable::Pipeline::uniforms):
+	// (read by draw(); e.g., write per-frame values here before drawing)
+	std::vector< float > uniform_arena;
+
+	//Transforms can be looked up by name through an index, which is built on load() and brought up to date
+	// by each lookup: it is rebuilt when transforms are added, removed, or renamed with set_name().
+	//first transform (in slot order) with the given name, or nullptr if there is none:
+	Transform *find_transform(std::string_view name);
+	Transform const *find_transform(std::string_view name) const;
+	//all transforms whose names match a pattern, in slot order:
+	// ('*' matches any run of characters and '?' matches any one character; e.g., "*.FL" or "Leg.??")
+	void find_transforms(std::string_view pattern, std::vector< Transform * > *found);
+
+	struct NameIndex {
+		//open-addressed (linear probing) hash table of transform slot indices:
+		// (size is a power of two, at most half full; entries with the same name are in slot order)
+		struct Entry {
+			uint32_t hash;
+			uint32_t slot = -1U; //-1U for empty entries
+		};
+		std::vector< Entry > table;
+		//transform slot indices, sorted by name (so patterns with a literal prefix only check names with that prefix):
+		std::vector< uint32_t > sorted;
+		bool built = false;
+		uint32_t transforms_revision = 0; //transforms.revision() when built
+		uint32_t renames = 0; //Transform::renames when built
+	};
+	mutable NameIndex name_index;
+	void update_name_index() const;
+	uint32_t find_transform_slot(std::string_view name) const; //(-1U if not found)
 
 	//The "draw" function provides a convenient way to pass all the things in a scene to OpenGL:
+	// (drawables are sorted by program, vertex array, and textures -- not drawn in list order --
+	//  so that state is only changed when it needs to be; runs of drawables that differ only by
+	//  transform are drawn with a single instanced call if their pipeline has an instanced_program)
+	// this sorting is done once, into a list of commands (see DrawList below) that is replayed every draw
 	void draw(Camera const &camera) const;
 
 	//..sometimes, you want to draw with a custom projection matrix and/or light space:
 	void draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f)) const;
 
+	//Counts from the most recent call to draw():
+	struct DrawStats {
+		uint32_t drawn = 0; //drawables sent to OpenGL
+		uint32_t culled = 0; //drawables skipped because their bounds were outside the view frustum
+		uint32_t occluded = 0; //drawables skipped because their bounds were hidden behind occluders
+		uint32_t occluders = 0; //occluders drawn into the occlusion buffer
+		uint32_t state_changes = 0; //program, vertex array, and texture binds made
+		uint32_t state_changes_elided = 0; //binds (and un-binds) skipped because the state was already set
+		uint32_t draw_calls = 0; //glDraw* calls made
+		uint32_t instanced = 0; //drawables drawn as part of an instanced group
+		uint32_t buffered = 0; //drawables whose matrices came from the per-frame instances buffer (rather than uniforms)
+		uint32_t lights = 0; //lights binned into clusters (0 if no drawn pipeline uses_lights)
+		uint32_t lights_dropped = 0; //cluster-light pairs dropped because the cluster lists were full
+		uint32_t matrices_updated = 0; //buffered drawables whose matrices were recomputed (because their transform moved)
+		uint32_t reduced_lod = 0; //drawables drawn with one of their simpler LODs
+		uint64_t vertices = 0; //vertices sent to OpenGL (counting each instance)
+		bool draw_list_rebuilt = false; //did the draw list need to be rebuilt?
+	};
+	mutable DrawStats draw_stats;
+
+	//Occlusion culling: draw() first draws the boxes of visible occluders (see Drawable::occluder_min/max) into a
+	// small CPU depth buffer, then skips drawables whose bounds are entirely behind what was drawn there.
+	// Only occluders that cover at least occluder_screen_size of the view's height (measured as for LODs) are
+	//  drawn, and at most max_occluders of them -- the largest on screen, in no particular order -- (so setting
+	//  max_occluders to zero turns occlusion culling off).
+	float occluder_screen_size = 0.05f;
+	uint32_t max_occluders = 64;
+	mutable OcclusionBuffer occlusion_buffer;
+
+	//lights binned into view clusters by draw() (kept between draws to re-use allocations):
+	mutable LightClusters light_clusters;
+
+	//GL objects (buffer textures) made by draw() are not freed when the scene is destroyed, since that may happen after
+	// the GL context is gone (e.g., for scenes at global scope); free them with this while the context is current:
+	void release_buffers() const;
+
+	//A buffer of data that shaders read through a texture (with texelFetch), used by draw():
+	struct BufferTexture {
+		GLuint buffer = 0;
+		GLuint texture = 0;
+		//replace contents (creates the buffer and texture on first use):
+		// NOTE: creation disturbs the GL_TEXTURE_BUFFER binding of the active texture unit
+		void upload(GLenum format, void const *data, size_t size, GLenum usage = GL_STREAM_DRAW);
+		//replace part of the contents:
+		void update(size_t offset, void const *data, size_t size);
+		//delete the buffer and texture (requires a current GL context; otherwise they are left for the context's teardown):
+		void release();
+		BufferTexture() = default;
+		BufferTexture(BufferTexture const &) = delete;
+	};
+
+	//draw() works from a list of commands compiled from drawables, with pipeline state resolved and
+	// drawables sorted and grouped; each draw() only culls, patches the matrices of drawables that moved, and replays.
+	// The list is rebuilt when drawables are added or removed, or report changes (see Drawable::set_pipeline).
+	void invalidate_draw_list() const { draw_list.built = false; }
+
+	struct DrawList {
+		//drawables that share all state but their transforms, drawn together:
+		struct Command {
+			Drawable const *drawable; //first drawable (for uniforms and uniform locations)
+			GLuint program; //program to use (the pipeline's instanced_program for buffered commands)
+			GLuint vao;
+			GLenum type;
+			GLuint start, count;
+			GLenum index_type;
+			GLint base_vertex;
+			Drawable::Pipeline::TextureInfo textures[Drawable::Pipeline::TextureCount];
+			bool buffered; //matrices come from the instances buffer (otherwise from uniforms; only one member)
+			bool uses_lights;
+			Drawable::LOD lods[Drawable::LODCount]; //(shared by every member)
+			uint32_t lod_count; //number of lods in use
+			uint32_t first_member, member_count; //range in members
+		};
+		std::vector< Command > commands;
+		//slot indices (in drawables) of each command's drawables, in command order:
+		// (a buffered member's index in this list is also its matrix slot in instances)
+		std::vector< uint32_t > members;
+		std::vector< uint32_t > member_commands; //index in commands of each member
+		std::vector< uint32_t > drawable_members; //index in members of each drawable (by slot index), or -1U if not in the list
+		//transform state each member's matrices were computed from:
+		struct Source {
+			Transform const *transform;
+			uint32_t local_to_world_revision;
+		};
+		std::vector< Source > sources;
+		//(transform, member) for buffered members, sorted, to find the members whose matrices a moved transform affects:
+		std::vector< std::pair< Transform const *, uint32_t > > buffered_by_transform;
+		MovedList::Reader moved; //position in moved_transforms
+		std::vector< glm::vec4 > instances; //per member, InstanceTexels (only used for buffered members)
+		BufferTexture instances_texture; //instances, on the GPU
+		BufferTexture slots_texture; //per-draw list of the matrix slots of visible members of buffered commands
+		BufferTexture lights_texture, light_ranges_texture, light_indices_texture; //light clusters (see LightClusters.hpp)
+		bool built = false;
+		bool uploaded = false; //has instances_texture been filled since the list was built?
+		uint32_t drawables_revision = 0; //drawables.revision() when built
+		uint32_t pipeline_changes = 0; //Drawable::pipeline_changes when built
+
+		//per-draw scratch space (kept between draws to re-use allocations):
+		struct Draw {
+			Command const *command;
+			uint32_t first; //buffered commands: first entry in slots; otherwise: the member to draw
+			uint32_t count; //number of members to draw
+			uint32_t lod; //0 for the command's own vertices, otherwise command->lods[lod-1]
+		};
+		std::vector< Draw > draws;
+		std::vector< uint32_t > visible; //slot indices of drawables that might be visible
+		std::vector< uint32_t > visible_members; //members of visible drawables, in member order
+		std::vector< uint32_t > slots; //matrix slots of members of buffered commands to draw
+		std::vector< glm::uvec2 > picked; //(member, lod) of visible members of a command
+		std::vector< std::pair< float, uint32_t > > occluders; //(-screen size, index) of visible occluders
+		std::vector< LightClusters::Light > cluster_lights;
+		std::vector< uint32_t > changed; //members whose matrices changed
+		std::vector< GLuint > programs_with_world_uniforms; //instanced programs whose per-frame uniforms have been set
+	};
+	mutable DrawList draw_list;
+	void update_draw_list() const;
+
+	//Drawables' world-space bounding boxes are kept in a bounding volume hierarchy, so draw()
+	// and the queries below only look at drawables near the query.
+	// The hierarchy is brought up to date by each draw() or query: it is rebuilt when drawables
+	//  are added or removed, and refit when their transforms move or they report changes (see Drawable::set_bounds).
+	// Only the drawables whose transforms have moved (see MovedList) are refit, along with the nodes above them.
+
+	//slot indices (in drawables) of drawables that might be visible through world_to_clip, in slot order:
+	// (includes all drawables without bounds)
+	void find_visible_drawables(glm::mat4 const &world_to_clip, std::vector< uint32_t > *visible) const;
+	//slot indices of drawables whose world-space bounding boxes overlap [min,max]:
+	void find_overlapping_drawables(glm::vec3 const &min, glm::vec3 const &max, std::vector< uint32_t > *overlapping) const;
+	//slot indices of drawables whose world-space bounding boxes are within radius of center:
+	void find_drawables_in_sphere(glm::vec3 const &center, float radius, std::vector< uint32_t > *found) const;
+	//slot indices of the (up to) k drawables whose world-space bounding boxes are closest to point, nearest first:
+	// (ignores drawables further than max_distance; if distances is non-null, it gets each drawable's distance)
+	void find_nearest_drawables(glm::vec3 const &point, uint32_t k, std::vector< uint32_t > *nearest,
+		std::vector< float > *distances = nullptr, float max_distance = std::numeric_limits< float >::infinity()) const;
+	//slot index of the closest drawable whose (object-space) bounding box is hit by a ray, or -1U if none is hit:
+	// (distance is in units of direction; rays that start inside a drawable's box hit it at distance 0)
+	uint32_t raycast_drawables(glm::vec3 const &origin, glm::vec3 const &direction, float *distance = nullptr) const;
+	//fraction of 'step' (in [0,1]) that something at origin can move before coming within 'radius' (along the step)
+	// of the first drawable box in its way -- e.g., for walking without passing through things:
+	// (boxes that already contain origin are ignored, so whatever starts inside a box can still move out of it)
+	float step_fraction(glm::vec3 const &origin, glm::vec3 const &step, float radius) const;
+
+	//Batched versions of the queries above (the hierarchy is brought up to date once, then every query is answered):
+	struct Ray {
+		glm::vec3 origin;
+		glm::vec3 direction;
+	};
+	struct RayHit {
+		uint32_t drawable = -1U; //slot index, or -1U if nothing was hit
+		float distance = std::numeric_limits< float >::infinity(); //in units of direction
+	};
+	void raycast_drawables(std::vector< Ray > const &rays, std::vector< RayHit > *hits) const;
+	//drawables overlapping box i are overlapping[ranges[i].x] through overlapping[ranges[i].x + ranges[i].y - 1]:
+	struct Box {
+		glm::vec3 min;
+		glm::vec3 max;
+	};
+	void find_overlapping_drawables(std::vector< Box > const &boxes, std::vector< glm::uvec2 > *ranges, std::vector< uint32_t > *overlapping) const;
+
+	//check every drawable for changes and refit the hierarchy to match:
+	void refit_drawables_bvh() const;
+	//rebuild the hierarchy from scratch (e.g., after lots of movement has made the refit tree loose):
+	void rebuild_drawables_bvh() const;
+
+	struct DrawablesBVH {
+		BVH bvh; //item ids are drawable slot indices
+		//state each item's bounds were computed from (in the same order as bvh.items):
+		struct Source {
+			Transform const *transform;
+			uint32_t local_to_world_revision;
+			glm::vec3 min, max;
+		};
+		std::vector< Source > sources;
+		std::vector< uint32_t > unbounded; //slot indices of drawables without bounds (not in bvh)
+		bool built = false;
+		uint32_t drawables_revision = 0; //drawables.revision() when built
+		uint32_t bounds_changes = 0; //Drawable::bounds_changes when last checked
+		//(transform, item) for each item, sorted, to find the items that a moved transform affects:
+		std::vector< std::pair< Transform const *, uint32_t > > items_by_transform;
+		MovedList::Reader moved; //position in moved_transforms
+		std::vector< uint32_t > changed; //items refit by the most recent update (kept to re-use allocations)
+	};
+	mutable DrawablesBVH drawables_bvh;
+	void update_drawables_bvh() const;
+
 	//add transforms/objects/cameras from a scene file to this scene:
 	// the 'on_drawable' callback gives your code a chance to look up mesh data and make Drawables:
 	// throws on file format errors
+	// (this is parse() followed by a commit() with no time limit)
 	void load(std::string const &filename,
 		std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable = nullptr
 	);
 
+	//Loading can also be split in two, so that big files don't stall the game loop:
+	// parse() maps and validates a scene file (without touching OpenGL or any Scene), so it can run on a worker thread;
+	// commit() then adds the parsed objects to a scene -- on the main thread, since on_drawable generally uses OpenGL
+	struct LoadBatch {
+		std::string filename;
+		std::unique_ptr< MappedFile > file; //chunks below point into this mapping
+
+		struct HierarchyEntry {
+			uint32_t parent;
+			uint32_t name_begin;
+			uint32_t name_end;
+			glm::vec3 position;
+			glm::quat rotation;
+			glm::vec3 scale;
+		};
+		struct MeshEntry {
+			uint32_t transform;
+			uint32_t name_begin;
+			uint32_t name_end;
+		};
+		struct CameraEntry {
+			uint32_t transform;
+			char type[4]; //"pers" or "orth"
+			float data; //fov in degrees for 'pers', scale for 'orth'
+			float clip_near, clip_far;
+		};
+		struct LightEntry {
+			uint32_t transform;
+			char type;
+			glm::u8vec3 color;
+			float energy;
+			float distance; //cutoff distance in "lmp1" chunks (0 for none); ignored in "lmp0" chunks
+			float fov;
+		};
+		struct TrackEntry {
+			uint32_t transform;
+			char channel;
+			uint8_t padding[3];
+			uint32_t key_begin, key_end;
+		};
+		struct KeyEntry {
+			float time;
+			glm::vec4 value;
+		};
+		//chunks (all indices have been checked by parse()):
+		ChunkView< char > names;
+		ChunkView< HierarchyEntry > hierarchy;
+		ChunkView< MeshEntry > meshes;
+		ChunkView< CameraEntry > cameras;
+		ChunkView< LightEntry > lights;
+		bool light_cutoffs = false; //lights are from an "lmp1" chunk (so have cutoff distances)
+		ChunkView< TrackEntry > tracks; //(optional; empty if the file has no animation)
+		ChunkView< KeyEntry > keys;
+		char const *extra = nullptr; //rest of the file (for load_extra)
+
+		//how far commit() has gotten:
+		std::vector< Transform * > hierarchy_transforms; //transforms made so far
+		uint32_t meshes_committed = 0;
+		bool committed = false;
+	};
+	//map and check a scene file (throws on file format errors):
+	// (also reads every page of the file, so that commit() doesn't wait on the disk)
+	static std::unique_ptr< LoadBatch > parse(std::string const &filename);
+	//add (more of) a parsed batch's objects to this scene, stopping once 'budget' seconds have passed:
+	// returns true once everything in the batch has been added (and load_extra has been called)
+	// (objects are added in file order -- transforms, then meshes, then cameras and lights -- so a partly
+	//  committed scene has every transform that its drawables use)
+	bool commit(LoadBatch &batch,
+		std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable = nullptr,
+		float budget = std::numeric_limits< float >::infinity()
+	);
+
+	//Runs parse() on a worker thread, then commit()s in per-frame pieces:
+	// Scene::Streaming streaming("level.scene");
+	// ..in each update: if (streaming.update(&scene, on_drawable, 0.002f)) { /* all loaded */ }
+	struct Streaming {
+		Streaming(std::string const &filename);
+		//commit for up to 'budget' seconds if parsing has finished; returns true once everything is committed:
+		// (rethrows any exception from parse() -- on this and every later call)
+		bool update(Scene *scene,
+			std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable,
+			float budget
+		);
+		std::future< std::unique_ptr< LoadBatch > > parsing; //(no longer valid once parsing has finished)
+		std::unique_ptr< LoadBatch > batch;
+		std::exception_ptr failure; //what parse() threw, if it failed
+	};
+
 	//this function is called to read extra chunks from the scene file after the main chunks are read:
 	// this is useful if you, e.g., subclassing scene to represent a game level/area
-	virtual void load_extra(std::istream &from, std::vector< char > const &str0, std::vector< Transform * > const &xfh0) { }
+	// (the file is memory-mapped while loading; 'from' and 'str0' read directly from the mapping, so are only valid during the call)
+	virtual void load_extra(std::istream &from, std::string_view str0, std::vector< Transform * > const &xfh0) { }
 
 	//empty scene:
 	Scene() = default;
@@ -149,5 +686,57 @@ struct Scene {
 	Scene(Scene const &); //...as a constructor
 	Scene &operator=(Scene const &); //...as scene = scene
 	//... as a set() function that optionally returns the transform->transform mapping:
+	// (copies keep pool slot indices, so pointers are remapped by index -- the map is only built if requested)
 	void set(Scene const &, std::unordered_map< Transform const *, Transform * > *transform_map = nullptr);
+
+	//A prefab is a scene compiled for spawning many copies ("instances") into other scenes:
+	// it is built once -- the transform hierarchy flattened into parent-first order, and drawables, lights, and
+	//  tracks detached from their transforms -- so spawning is a straight copy, with no lookups or sorting.
+	// Each instance gets its own copies of the transforms (names included), drawables (pipelines included),
+	//  lights, and tracks; only animation keys and uniform_arena values are shared: they are added to a scene
+	//  once, however many instances use them (so instances share arena uniform values).
+	// (cameras are not part of prefabs)
+	struct Prefab {
+		Prefab(Scene const &scene);
+
+		//transforms, with parents before children:
+		struct Node {
+			uint32_t parent; //index in nodes, or -1U for the prefab's roots
+			glm::vec3 position;
+			glm::quat rotation;
+			glm::vec3 scale;
+		};
+		std::vector< Node > nodes;
+		std::vector< std::string > names; //per node
+
+		//objects attached to nodes (their transform pointers are null; *_nodes give the node of each):
+		std::vector< Drawable > drawables; //(arena uniform offsets index uniform_arena below)
+		std::vector< uint32_t > drawable_nodes;
+		std::vector< Light > lights;
+		std::vector< uint32_t > light_nodes;
+		std::vector< Track > tracks; //(key_begin/key_end index keys)
+		std::vector< uint32_t > track_nodes;
+
+		struct Keys {
+			std::vector< float > times;
+			std::vector< glm::vec4 > values;
+		};
+		std::shared_ptr< Keys const > keys;
+
+		std::shared_ptr< std::vector< float > const > uniform_arena; //the scene's uniform_arena
+
+		//index of the first node with a given name (-1U if none), e.g., to find parts of spawned instances:
+		uint32_t find_node(std::string_view name) const;
+		std::map< std::string, uint32_t, std::less<> > node_index; //name -> first node with that name
+	};
+
+	//add an instance of a prefab to this scene, with the prefab's roots parented to 'parent' (if not null):
+	// if 'spawned' is given, it is set to the instance's transforms, in prefab node order
+	// NOTE: rebuild any AnimationSampler of this scene afterward to play the instance's tracks
+	void spawn(Prefab const &prefab, Transform *parent = nullptr, std::vector< Transform * > *spawned = nullptr);
+
+	//prefab keys already added to key_times/key_values, and where they start:
+	std::vector< std::pair< std::shared_ptr< Prefab::Keys const >, uint32_t > > prefab_keys;
+	//prefab uniform arenas already added to uniform_arena, and where they start:
+	std::vector< std::pair< std::shared_ptr< std::vector< float > const >, uint32_t > > prefab_uniform_arenas;
 };
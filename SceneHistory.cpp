@@ -0,0 +1,266 @@
+#include "SceneHistory.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+//flags for each record in a snapshot:
+enum : uint8_t {
+	HasPosition = 1,
+	HasRotation = 2,
+	HasScale = 4,
+	Removed = 8, //transform in this slot was erased
+};
+
+//"smallest three" quaternion quantization:
+// the largest-magnitude component is dropped (it can be recovered from the others, since |q| = 1, once it is made positive)
+// and the other three -- each in [-1/sqrt(2), 1/sqrt(2)] -- are stored with 20 bits each; the top two bits say which was dropped
+static constexpr uint32_t RotationBits = 20;
+static constexpr float RotationMax = float((1u << RotationBits) - 1);
+static constexpr float RotationRange = 0.70710678f;
+
+static uint64_t pack_rotation(glm::quat const &rotation) {
+	glm::quat q = glm::normalize(rotation);
+	float c[4] = {q.x, q.y, q.z, q.w};
+	uint32_t largest = 0;
+	for (uint32_t i = 1; i < 4; ++i) {
+		if (std::abs(c[i]) > std::abs(c[largest])) largest = i;
+	}
+	float sign = (c[largest] < 0.0f ? -1.0f : 1.0f); //(q and -q are the same rotation)
+
+	uint64_t bits = uint64_t(largest) << (3 * RotationBits);
+	uint32_t shift = 0;
+	for (uint32_t i = 0; i < 4; ++i) {
+		if (i == largest) continue;
+		float t = (sign * c[i] / RotationRange) * 0.5f + 0.5f;
+		t = std::min(std::max(t, 0.0f), 1.0f);
+		bits |= uint64_t(std::lround(t * RotationMax)) << shift;
+		shift += RotationBits;
+	}
+	return bits;
+}
+
+static glm::quat unpack_rotation(uint64_t bits) {
+	uint32_t largest = uint32_t(bits >> (3 * RotationBits)) & 3;
+	float c[4];
+	float sum2 = 0.0f;
+	uint32_t shift = 0;
+	for (uint32_t i = 0; i < 4; ++i) {
+		if (i == largest) continue;
+		float t = float((bits >> shift) & ((1u << RotationBits) - 1)) / RotationMax;
+		c[i] = (t * 2.0f - 1.0f) * RotationRange;
+		sum2 += c[i] * c[i];
+		shift += RotationBits;
+	}
+	c[largest] = std::sqrt(std::max(0.0f, 1.0f - sum2));
+	return glm::quat(c[3], c[0], c[1], c[2]); //n.b. wxyz init order
+}
+
+//little helpers for reading/writing records:
+static void put_varint(std::vector< uint8_t > *to, uint32_t value) {
+	while (value >= 0x80) {
+		to->emplace_back(uint8_t(value | 0x80));
+		value >>= 7;
+	}
+	to->emplace_back(uint8_t(value));
+}
+
+static uint32_t get_varint(uint8_t const **at) {
+	uint32_t value = 0;
+	for (uint32_t shift = 0; ; shift += 7) {
+		uint8_t byte = *((*at)++);
+		value |= uint32_t(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) return value;
+	}
+}
+
+template< typename T >
+static void put(std::vector< uint8_t > *to, T const &value) {
+	size_t size = to->size();
+	to->resize(size + sizeof(T));
+	std::memcpy(to->data() + size, &value, sizeof(T));
+}
+
+template< typename T >
+static T get(uint8_t const **at) {
+	T value;
+	std::memcpy(&value, *at, sizeof(T));
+	*at += sizeof(T);
+	return value;
+}
+
+//-------------------------
+
+void SceneHistory::State::resize(uint32_t slots) {
+	if (slots <= present.size()) return;
+	positions.resize(slots, glm::vec3(0.0f));
+	rotations.resize(slots, 0);
+	unpacked.resize(slots, glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+	scales.resize(slots, glm::vec3(1.0f));
+	present.resize(slots, 0);
+}
+
+SceneHistory::SceneHistory(size_t memory_budget_) : memory_budget(memory_budget_) {
+}
+
+uint32_t SceneHistory::capture(Scene const &scene) {
+	uint32_t number = end();
+	bool key = (snapshots.empty() || number % KeyInterval == 0);
+
+	uint32_t slots = scene.transforms.slots();
+	last.resize(slots);
+
+	//(records are built in scratch, then copied into a snapshot of exactly the right size)
+	std::vector< uint8_t > &data = scratch;
+	data.clear();
+
+	uint32_t previous = -1U; //slot of the previous record
+	auto start_record = [&](uint32_t slot, uint8_t flags) {
+		put_varint(&data, slot - previous - 1);
+		data.emplace_back(flags);
+		previous = slot;
+	};
+
+	for (uint32_t slot = 0; slot < uint32_t(last.present.size()); ++slot) {
+		if (slot >= slots || !scene.transforms.occupied(slot)) {
+			if (last.present[slot]) {
+				start_record(slot, Removed);
+				last.present[slot] = 0;
+			}
+			continue;
+		}
+		Scene::Transform const &transform = scene.transforms.at_index(slot);
+		uint64_t rotation = pack_rotation(transform.rotation);
+
+		bool all = (key || !last.present[slot]);
+		uint8_t flags = 0;
+		if (all || transform.position != last.positions[slot]) flags |= HasPosition;
+		if (all || rotation != last.rotations[slot]) flags |= HasRotation;
+		if (all || transform.scale != last.scales[slot]) flags |= HasScale;
+		if (flags == 0) continue;
+
+		start_record(slot, flags);
+		if (flags & HasPosition) put(&data, transform.position);
+		if (flags & HasRotation) put(&data, rotation);
+		if (flags & HasScale) put(&data, transform.scale);
+
+		last.positions[slot] = transform.position;
+		last.rotations[slot] = rotation;
+		last.scales[slot] = transform.scale;
+		last.present[slot] = 1;
+	}
+	last.number = number;
+
+	snapshots.emplace_back();
+	snapshots.back().data.assign(data.begin(), data.end());
+	snapshots.back().key = key;
+	used += sizeof(Snapshot) + snapshots.back().data.capacity();
+
+	//stay within budget (but always keep the newest key snapshot and its deltas):
+	while (used > memory_budget) {
+		auto next_key = std::find_if(snapshots.begin() + 1, snapshots.end(), [](Snapshot const &s) { return s.key; });
+		if (next_key == snapshots.end()) break;
+		drop_oldest();
+	}
+
+	return number;
+}
+
+void SceneHistory::drop_oldest() {
+	assert(!snapshots.empty() && snapshots.front().key);
+	do {
+		used -= sizeof(Snapshot) + snapshots.front().data.capacity();
+		snapshots.pop_front();
+		first_number += 1;
+	} while (!snapshots.empty() && !snapshots.front().key);
+
+	if (decoded.number != -1U && decoded.number < first_number) decoded.number = -1U;
+}
+
+void SceneHistory::apply(Snapshot const &snapshot, State *state_) const {
+	State &state = *state_;
+	uint8_t const *at = snapshot.data.data();
+	uint8_t const *end = at + snapshot.data.size();
+	uint32_t slot = -1U;
+	while (at < end) {
+		slot += get_varint(&at) + 1;
+		uint8_t flags = *(at++);
+		state.resize(slot + 1);
+		if (flags & Removed) {
+			state.present[slot] = 0;
+			continue;
+		}
+		state.present[slot] = 1;
+		if (flags & HasPosition) state.positions[slot] = get< glm::vec3 >(&at);
+		if (flags & HasRotation) {
+			state.rotations[slot] = get< uint64_t >(&at);
+			state.unpacked[slot] = unpack_rotation(state.rotations[slot]);
+		}
+		if (flags & HasScale) state.scales[slot] = get< glm::vec3 >(&at);
+	}
+	assert(at == end);
+}
+
+void SceneHistory::decode(uint32_t number, State *state_) const {
+	State &state = *state_;
+	assert(number >= first() && number < end());
+
+	uint32_t begin;
+	if (state.number != -1U && state.number >= first() && state.number <= number) {
+		//continue from where state is:
+		begin = state.number + 1;
+	} else {
+		//start from the key snapshot at or before number:
+		begin = number;
+		while (!snapshots[begin - first_number].key) --begin;
+		std::fill(state.present.begin(), state.present.end(), uint8_t(0));
+	}
+
+	for (uint32_t n = begin; n <= number; ++n) {
+		apply(snapshots[n - first_number], &state);
+	}
+	state.number = number;
+}
+
+void SceneHistory::restore(uint32_t number, Scene *scene) {
+	assert(scene);
+	if (number < first() || number >= end()) {
+		throw std::runtime_error("Snapshot " + std::to_string(number) + " isn't stored (have [" + std::to_string(first()) + ", " + std::to_string(end()) + ")).");
+	}
+	decode(number, &decoded);
+
+	uint32_t slots = std::min(uint32_t(decoded.present.size()), scene->transforms.slots());
+	for (uint32_t slot = 0; slot < slots; ++slot) {
+		if (!decoded.present[slot] || !scene->transforms.occupied(slot)) continue;
+		Scene::Transform &transform = scene->transforms.at_index(slot);
+		glm::quat const &rotation = decoded.unpacked[slot];
+		if (transform.position == decoded.positions[slot] && transform.rotation == rotation && transform.scale == decoded.scales[slot]) continue;
+		transform.position = decoded.positions[slot];
+		transform.rotation = rotation;
+		transform.scale = decoded.scales[slot];
+		//(transforms are in topological order in loaded scenes, so children are usually already dirty by the time they are reached)
+		transform.mark_dirty();
+	}
+}
+
+void SceneHistory::discard_after(uint32_t number) {
+	if (number < first() || number >= end()) {
+		throw std::runtime_error("Snapshot " + std::to_string(number) + " isn't stored (have [" + std::to_string(first()) + ", " + std::to_string(end()) + ")).");
+	}
+	while (end() > number + 1) {
+		used -= sizeof(Snapshot) + snapshots.back().data.capacity();
+		snapshots.pop_back();
+	}
+	if (decoded.number != -1U && decoded.number > number) decoded.number = -1U;
+
+	//the next capture is compared to this snapshot:
+	if (decoded.number == number) {
+		last = decoded;
+	} else {
+		last.number = -1U;
+		decode(number, &last);
+	}
+}
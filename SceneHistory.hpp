@@ -0,0 +1,84 @@
+#pragma once
+
+/*
+ * A SceneHistory records snapshots of the position/rotation/scale of a scene's
+ *  transforms, for rewind and replay.
+ *
+ * Snapshots are compact:
+ *  - each one only stores the transforms that changed since the previous one
+ *    (except for a full "key" snapshot every KeyInterval snapshots),
+ *  - rotations are quantized to 64 bits ("smallest three" encoding);
+ *    positions and scales are stored exactly.
+ * The oldest snapshots are dropped (a key snapshot and its deltas at a time)
+ *  to stay within a memory budget.
+ *
+ * Transforms are identified by slot index in Scene::transforms, so snapshots
+ *  can be restored to the scene they were captured from or to a copy of it
+ *  (Scene::set keeps slot indices). Restoring never adds or removes transforms.
+ *
+ * Usage:
+ *  SceneHistory history(8 << 20); //8MB budget
+ *  uint32_t number = history.capture(scene); //e.g., every frame
+ *  history.restore(number, &scene); //rewind
+ *  history.discard_after(number); //..and record a different future from there
+ *
+ */
+
+#include "Scene.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+struct SceneHistory {
+	SceneHistory(size_t memory_budget = size_t(16) << 20);
+
+	//record the current state of scene's transforms; returns the new snapshot's number:
+	// (numbers count up from zero; old snapshots may be dropped to stay within the memory budget)
+	uint32_t capture(Scene const &scene);
+
+	//set scene's transforms to their state in a snapshot (throws if the snapshot isn't stored):
+	// (only transforms whose state differs are changed -- and marked dirty)
+	void restore(uint32_t number, Scene *scene);
+
+	//forget all snapshots after 'number', so the next capture follows it:
+	void discard_after(uint32_t number);
+
+	//stored snapshots are numbered [first(), end()):
+	uint32_t first() const { return first_number; }
+	uint32_t end() const { return first_number + uint32_t(snapshots.size()); }
+	size_t memory_used() const { return used; }
+
+	enum : uint32_t { KeyInterval = 64 };
+	size_t memory_budget;
+
+	//--- internals ---
+
+	//snapshot data is a sequence of changed-transform records, in slot order:
+	// varint (slot - previous record's slot - 1), flags byte, then position (3 floats), rotation (uint64), and/or scale (3 floats) as flagged
+	struct Snapshot {
+		std::vector< uint8_t > data;
+		bool key = false;
+	};
+	std::deque< Snapshot > snapshots;
+	uint32_t first_number = 0;
+	size_t used = 0;
+
+	//state of every transform slot, as of some snapshot:
+	struct State {
+		std::vector< glm::vec3 > positions;
+		std::vector< uint64_t > rotations; //quantized
+		std::vector< glm::quat > unpacked; //rotations, un-quantized (so restore() doesn't re-decode unchanged rotations)
+		std::vector< glm::vec3 > scales;
+		std::vector< uint8_t > present; //was there a transform in this slot?
+		uint32_t number = -1U; //snapshot this is the state of (-1U if none)
+		void resize(uint32_t slots);
+	};
+	State last; //state in the most recent snapshot (what the next capture is compared to)
+	State decoded; //state of the most recently restored snapshot (so replaying forward only decodes deltas)
+	std::vector< uint8_t > scratch; //(capture() builds snapshot data here)
+
+	void decode(uint32_t number, State *state) const; //bring state to a snapshot by applying stored snapshots
+	void apply(Snapshot const &snapshot, State *state) const;
+	void drop_oldest(); //drop the oldest key snapshot and its deltas
+};
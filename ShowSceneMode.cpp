@@ -28,6 +28,25 @@ bool ShowSceneMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_
 			camera.flip_x = (std::abs(camera.elevation) > 0.5f * 3.1415926f);
 			return true;
 		}
+		if (evt.button.button == SDL_BUTTON_RIGHT) {
+			//pick the drawable under the mouse:
+			// (ray through the mouse position, computed in camera space then moved to world space)
+			glm::vec2 ndc = glm::vec2(
+				(evt.button.x + 0.5f) / float(window_size.x) * 2.0f - 1.0f,
+				(evt.button.y + 0.5f) / float(window_size.y) *-2.0f + 1.0f
+			);
+			float tan_half_fovy = std::tan(0.5f * scene_camera->fovy);
+			float aspect = float(window_size.x) / float(window_size.y);
+			glm::mat4x3 camera_to_world = scene_camera->transform->make_local_to_world();
+			glm::vec3 origin = camera_to_world[3];
+			glm::vec3 direction = camera_to_world * glm::vec4(ndc.x * tan_half_fovy * aspect, ndc.y * tan_half_fovy, -1.0f, 0.0f);
+
+			picked = scene.raycast_drawables(origin, direction);
+			if (picked != -1U) {
+				std::cout << "Picked '" << scene.drawables.at_index(picked).transform->name << "'." << std::endl;
+			}
+			return true;
+		}
 	}
 	if (evt.type == SDL_MOUSEMOTION) {
 		if (evt.motion.state & SDL_BUTTON(SDL_BUTTON_LEFT)) {
@@ -75,12 +94,12 @@ bool ShowSceneMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_
 void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
 	//--- use camera structure to set up scene camera ---
 
-	scene_camera->transform->rotation =
+	scene_camera->transform->set_rotation(
 		glm::angleAxis(camera.azimuth, glm::vec3(0.0f, 0.0f, 1.0f))
 		* glm::angleAxis(0.5f * 3.1415926f + -camera.elevation, glm::vec3(1.0f, 0.0f, 0.0f))
-	;
-	scene_camera->transform->position = camera.target + camera.radius * (scene_camera->transform->rotation * glm::vec3(0.0f, 0.0f, 1.0f));
-	scene_camera->transform->scale = glm::vec3(1.0f);
+	);
+	scene_camera->transform->set_position(camera.target + camera.radius * (scene_camera->transform->rotation * glm::vec3(0.0f, 0.0f, 1.0f)));
+	scene_camera->transform->set_scale(glm::vec3(1.0f));
 	scene_camera->aspect = float(drawable_size.x) / float(drawable_size.y);
 
 
@@ -128,6 +147,20 @@ void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
 				glm::u8vec4(0xff, 0xff, 0xff, 0xff)
 			);
 		}
+
+		//picked drawable's bounding box:
+		if (picked != -1U && scene.drawables.occupied(picked)) {
+			Scene::Drawable const &drawable = scene.drawables.at_index(picked);
+			glm::vec3 r = 0.5f * (drawable.max - drawable.min);
+			glm::vec3 c = 0.5f * (drawable.max + drawable.min);
+			glm::mat4x3 box(
+				glm::vec3(r.x,  0.0f, 0.0f),
+				glm::vec3(0.0f,  r.y, 0.0f),
+				glm::vec3(0.0f, 0.0f,  r.z),
+				c
+			);
+			draw_lines.draw_box(drawable.transform->make_local_to_world() * glm::mat4(box), glm::u8vec4(0xff, 0x88, 0x00, 0xff));
+		}
 		/*
 		glEnable(GL_LINE_SMOOTH);
 		glEnable(GL_BLEND);
@@ -30,6 +30,9 @@ struct ShowSceneMode : Mode {
 	//Scene being viewed:
 	Scene const &scene;
 
+	//slot index (in scene.drawables) of the drawable last picked with the right mouse button, or -1U:
+	uint32_t picked = -1U;
+
 	//mode uses a secondary Scene to hold a camera:
 	Scene camera_scene;
 	Scene::Camera *scene_camera = nullptr;
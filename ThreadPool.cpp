@@ -0,0 +1,79 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+ThreadPool::ThreadPool(uint32_t threads) : next(0) {
+	if (threads == 0) threads = std::max(1U, std::thread::hardware_concurrency());
+
+	workers.reserve(threads - 1);
+	for (uint32_t t = 0; t + 1 < threads; ++t) {
+		workers.emplace_back([this](){
+			uint64_t seen = 0;
+			std::unique_lock< std::mutex > lock(mutex);
+			while (true) {
+				work_cv.wait(lock, [&](){ return quit || generation != seen; });
+				if (quit) return;
+				seen = generation;
+
+				++busy;
+				lock.unlock();
+				run_job();
+				lock.lock();
+				--busy;
+				if (busy == 0) done_cv.notify_all();
+			}
+		});
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		quit = true;
+	}
+	work_cv.notify_all();
+	for (auto &worker : workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::run_job() {
+	//claim indices until none are left:
+	// (a worker that wakes up late finds next >= job_count and does nothing)
+	while (true) {
+		uint32_t i = next.fetch_add(1);
+		if (i >= job_count) break;
+		(*job)(i);
+	}
+}
+
+void ThreadPool::parallel_for(uint32_t count, std::function< void(uint32_t) > const &fn) {
+	if (count == 0) return;
+	if (workers.empty() || count == 1) {
+		for (uint32_t i = 0; i < count; ++i) {
+			fn(i);
+		}
+		return;
+	}
+
+	{ //post job:
+		std::unique_lock< std::mutex > lock(mutex);
+		//workers still finishing (stale) calls to run_job() must leave before the job changes:
+		done_cv.wait(lock, [&](){ return busy == 0; });
+		job = &fn;
+		job_count = count;
+		next = 0;
+		++generation;
+	}
+	work_cv.notify_all();
+
+	//help out:
+	run_job();
+
+	{ //every index has been claimed; wait for workers to finish the ones they claimed:
+		std::unique_lock< std::mutex > lock(mutex);
+		done_cv.wait(lock, [&](){ return busy == 0; });
+		job = nullptr;
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+/*
+ * A ThreadPool keeps a set of worker threads around so that data-parallel
+ *  work (e.g., updating many transforms) can be spread across cores without
+ *  creating threads every frame.
+ *
+ * Usage:
+ *  ThreadPool pool; //one thread per core (counting the calling thread)
+ *  pool.parallel_for(count, [&](uint32_t i){ ... });
+ *
+ */
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <atomic>
+
+struct ThreadPool {
+	//create a pool that uses 'threads' threads in total (including the thread that calls parallel_for):
+	// (0 means "one per hardware thread")
+	ThreadPool(uint32_t threads = 0);
+	~ThreadPool();
+
+	//call fn(i) for every i in [0,count), spread across all threads; returns once every call is finished:
+	// note: fn must not throw; parallel_for must not be called concurrently or from inside fn
+	void parallel_for(uint32_t count, std::function< void(uint32_t) > const &fn);
+
+	//total number of threads that run work (workers + calling thread):
+	uint32_t size() const { return uint32_t(workers.size()) + 1; }
+
+	//pools own threads, so they are not copyable:
+	ThreadPool(ThreadPool const &) = delete;
+	ThreadPool &operator=(ThreadPool const &) = delete;
+
+	//-- internals ---
+	void run_job();
+
+	std::vector< std::thread > workers;
+
+	std::mutex mutex;
+	std::condition_variable work_cv; //signaled when a new job is posted (or on quit)
+	std::condition_variable done_cv; //signaled when the last busy worker finishes
+	uint64_t generation = 0; //incremented for every job
+	uint32_t busy = 0; //workers currently inside run_job()
+	bool quit = false;
+
+	//current job:
+	std::function< void(uint32_t) > const *job = nullptr;
+	uint32_t job_count = 0;
+	std::atomic< uint32_t > next;
+};
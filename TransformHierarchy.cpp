@@ -0,0 +1,135 @@
+#include "TransformHierarchy.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+TransformHierarchy::TransformHierarchy(Scene &scene) {
+	build(scene);
+}
+
+void TransformHierarchy::build(Scene &scene) {
+	transforms.clear();
+	parents.clear();
+	level_begins.clear();
+	transforms.reserve(scene.transforms.size());
+	parents.reserve(scene.transforms.size());
+
+	//roots (in scene order) make up the first level:
+	for (auto &t : scene.transforms) {
+		if (t.parent) continue;
+		transforms.emplace_back(&t);
+		parents.emplace_back(-1U);
+	}
+
+	//breadth-first walk -- children of level i make up level i+1:
+	uint32_t begin = 0;
+	while (begin < size()) {
+		level_begins.emplace_back(begin);
+		uint32_t end = size();
+		for (uint32_t i = begin; i < end; ++i) {
+			uint32_t first = size();
+			for (Scene::Transform *child = transforms[i]->first_child; child; child = child->next_sibling) {
+				transforms.emplace_back(child);
+				parents.emplace_back(i);
+			}
+			//child lists are stored newest-first; reverse to get creation order:
+			std::reverse(transforms.begin() + first, transforms.end());
+		}
+		begin = end;
+	}
+	level_begins.emplace_back(size());
+
+	assert(transforms.size() == scene.transforms.size() && "every transform is reachable from some root");
+
+	positions.resize(transforms.size());
+	rotations.resize(transforms.size());
+	scales.resize(transforms.size());
+	local_to_world.resize(transforms.size());
+
+	pull();
+}
+
+void TransformHierarchy::pull() {
+	for (uint32_t i = 0; i < size(); ++i) {
+		Scene::Transform const &t = *transforms[i];
+		assert(t.parent == (parents[i] == -1U ? nullptr : transforms[parents[i]]) && "hierarchy changed since build()");
+		positions[i] = t.position;
+		rotations[i] = t.rotation;
+		scales[i] = t.scale;
+	}
+}
+
+void TransformHierarchy::push() {
+	for (uint32_t i = 0; i < size(); ++i) {
+		Scene::Transform &t = *transforms[i];
+		t.position = positions[i];
+		t.rotation = rotations[i];
+		t.scale = scales[i];
+		//every transform is visited, so the "dirty implies descendants dirty" invariant holds for both caches:
+		t.local_to_world = local_to_world[i];
+		t.local_to_world_dirty = false;
+		t.world_to_local_dirty = true;
+		t.local_to_world_revision += 1;
+		t.report_moved();
+	}
+	if (size()) Scene::Transform::changes.fetch_add(1, std::memory_order_relaxed);
+}
+
+void TransformHierarchy::update() {
+	for (uint32_t l = 0; l + 1 < level_begins.size(); ++l) {
+		update_batched(level_begins[l], level_begins[l+1]);
+	}
+}
+
+void TransformHierarchy::update_reference(uint32_t begin, uint32_t end) {
+	//same arithmetic as Scene::Transform::make_local_to_world, but parents are always already computed:
+	for (uint32_t i = begin; i < end; ++i) {
+		glm::mat4x3 local_to_parent = Scene::Transform::make_local_to_parent(positions[i], rotations[i], scales[i]);
+		if (parents[i] == -1U) {
+			local_to_world[i] = local_to_parent;
+		} else {
+			local_to_world[i] = local_to_world[parents[i]] * glm::mat4(local_to_parent); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+		}
+	}
+}
+
+void TransformHierarchy::update_batched(uint32_t begin, uint32_t end) {
+	assert(begin <= end && end <= size());
+
+	//hand the kernel (see Scene::Transform::compute_local_to_world) a few batches at a time:
+	constexpr uint32_t Chunk = 8 * Scene::Transform::KernelWidth;
+	glm::mat4x3 const *parent_matrices[Chunk];
+	for (uint32_t base = begin; base < end; base += Chunk) {
+		uint32_t count = std::min(Chunk, end - base);
+		for (uint32_t k = 0; k < count; ++k) {
+			uint32_t parent = parents[base + k];
+			assert((parent == -1U || parent < begin) && "parents must be in an earlier level");
+			parent_matrices[k] = (parent == -1U ? nullptr : &local_to_world[parent]);
+		}
+		Scene::Transform::compute_local_to_world(count, &positions[base], &rotations[base], &scales[base], parent_matrices, &local_to_world[base]);
+	}
+}
+
+void TransformHierarchy::update(ThreadPool &pool) {
+	//levels smaller than this are not worth splitting:
+	constexpr uint32_t MinChunk = 1024;
+
+	for (uint32_t l = 0; l + 1 < level_begins.size(); ++l) {
+		uint32_t begin = level_begins[l];
+		uint32_t end = level_begins[l+1];
+
+		uint32_t chunks = std::min(pool.size(), (end - begin) / MinChunk);
+		if (chunks <= 1) {
+			update_batched(begin, end);
+			continue;
+		}
+		//chunk size, rounded up to a whole number of batches:
+		constexpr uint32_t Width = Scene::Transform::KernelWidth;
+		uint32_t chunk = ((end - begin + chunks - 1) / chunks + Width - 1) / Width * Width;
+		pool.parallel_for(chunks, [&](uint32_t c){
+			uint32_t chunk_begin = std::min(end, begin + c * chunk);
+			uint32_t chunk_end = std::min(end, chunk_begin + chunk);
+			update_batched(chunk_begin, chunk_end);
+		});
+	}
+}
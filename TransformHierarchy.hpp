@@ -0,0 +1,87 @@
+#pragma once
+
+/*
+ * A TransformHierarchy is a flat, structure-of-arrays copy of the transforms in a Scene.
+ *
+ * Transforms are stored in topological order, grouped by depth: all roots come first,
+ *  then all of their children, then all grandchildren, and so on. Every transform in a
+ *  level has its parent in an earlier level, so world matrices can be computed with a
+ *  single linear pass over contiguous arrays, several transforms at a time (see update()).
+ *
+ * The Scene::Transform objects remain the stable handles that other code holds pointers to:
+ *  - pull() copies position/rotation/scale out of the transforms,
+ *  - update() computes all local-to-world matrices,
+ *  - push() writes values and computed world matrices back into the transforms,
+ *    so Transform::make_local_to_world() becomes a cached read afterward.
+ *
+ * Usage:
+ *  TransformHierarchy hierarchy(scene);
+ *  //each frame:
+ *  hierarchy.pull(); hierarchy.update(); hierarchy.push();
+ *
+ * NOTE: call build() again after adding transforms or changing parents.
+ *
+ */
+
+#include "Scene.hpp"
+#include "ThreadPool.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+
+struct TransformHierarchy {
+	TransformHierarchy() = default;
+	TransformHierarchy(Scene &scene);
+
+	//(re-)gather the structure of the scene's transforms into the flat arrays:
+	// (also pulls current position/rotation/scale)
+	void build(Scene &scene);
+
+	//copy position/rotation/scale from the transforms into the arrays:
+	void pull();
+
+	//compute local_to_world for every transform in a single pass:
+	// uses the SIMD kernel behind Scene::Transform::update_local_to_world (AVX or SSE when compiled for them,
+	// scalar otherwise), which performs the same float operations, in the same order, as make_local_to_world
+	void update();
+
+	//as above, but with each level split across the threads of a pool:
+	// (every transform is computed by the same kernel, so results are identical to update())
+	void update(ThreadPool &pool);
+
+	//compute local_to_world for transforms [begin,end) one at a time with glm:
+	// (all of their parents must already be computed; used for comparison and testing)
+	void update_reference(uint32_t begin, uint32_t end);
+
+	//compute local_to_world for transforms [begin,end) with the batched kernel:
+	// (range must lie within a single level)
+	void update_batched(uint32_t begin, uint32_t end);
+
+	//copy position/rotation/scale from the arrays back to the transforms,
+	// and store the computed local_to_world matrices in the transforms' caches:
+	void push();
+
+	uint32_t size() const { return uint32_t(transforms.size()); }
+
+	//--- hierarchy data (all arrays have size() elements) ---
+
+	//handles: the Scene::Transform each entry corresponds to:
+	std::vector< Scene::Transform * > transforms;
+
+	//index of parent (always in an earlier level), or -1U for roots:
+	std::vector< uint32_t > parents;
+
+	//local transformation relative to parent:
+	std::vector< glm::vec3 > positions;
+	std::vector< glm::quat > rotations;
+	std::vector< glm::vec3 > scales;
+
+	//computed by update():
+	std::vector< glm::mat4x3 > local_to_world;
+
+	//depth levels: level i is the index range [ level_begins[i], level_begins[i+1] )
+	// (so level_begins.back() == size())
+	std::vector< uint32_t > level_begins;
+};
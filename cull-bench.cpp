@@ -0,0 +1,102 @@
+//Microbenchmark comparing ways of finding the drawables visible from a camera:
+// - "linear": test every drawable's bounding box against the view frustum
+// - "bvh": Scene::find_visible_drawables (bounding volume hierarchy), then the same per-drawable test
+//          on the drawables it returns (this is what Scene::draw does)
+//Also reports the cost of keeping the hierarchy up to date when some drawables move.
+//
+//Usage: cull-bench [drawable count] [iterations]
+// (with no arguments, runs 100k drawables)
+
+#include "Scene.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+
+template< typename F >
+static double time_ms(uint32_t iterations, F const &f) {
+	auto before = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < iterations; ++i) {
+		f();
+	}
+	auto after = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration< double, std::milli >(after - before).count() / iterations;
+}
+
+int main(int argc, char **argv) {
+	uint32_t count = 100000;
+	uint32_t iterations = 50;
+	if (argc > 1) count = uint32_t(std::stoul(argv[1]));
+	if (argc > 2) iterations = uint32_t(std::stoul(argv[2]));
+
+	std::mt19937 mt(0x15466);
+	std::uniform_real_distribution< float > unit(-1.0f, 1.0f);
+
+	//drawables (unit-ish boxes) scattered over a large, flat level:
+	Scene scene;
+	float extent = 10.0f * std::sqrt(float(count));
+	std::vector< Scene::Transform * > transforms;
+	transforms.reserve(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		Scene::Transform &transform = scene.transforms.emplace_back();
+		transform.position = glm::vec3(unit(mt) * extent, unit(mt) * extent, unit(mt) * 5.0f);
+		transform.rotation = glm::normalize(glm::quat(unit(mt), unit(mt), unit(mt), unit(mt)));
+		transforms.emplace_back(&transform);
+
+		Scene::Drawable &drawable = scene.drawables.emplace_back(&transform);
+		drawable.min = glm::vec3(-1.0f, -1.0f, -0.5f);
+		drawable.max = glm::vec3( 1.0f,  1.0f,  2.0f);
+	}
+
+	//camera above the middle of the level, looking down at part of it:
+	Scene::Camera camera(&scene.transforms.emplace_back());
+	camera.transform->position = glm::vec3(0.0f, 0.0f, 100.0f);
+	camera.transform->rotation = glm::angleAxis(0.1f * 3.1415926f, glm::vec3(1.0f, 0.0f, 0.0f));
+	camera.aspect = 16.0f / 9.0f;
+	glm::mat4 world_to_clip = camera.make_projection() * glm::mat4(camera.transform->make_world_to_local());
+
+	std::cout << count << " drawables, " << iterations << " iterations:" << std::endl;
+
+	std::vector< uint32_t > linear_visible;
+	double linear_ms = time_ms(iterations, [&](){
+		linear_visible.clear();
+		for (auto d = scene.drawables.begin(); d != scene.drawables.end(); ++d) {
+			if (!d->outside(world_to_clip * glm::mat4(d->transform->make_local_to_world()))) linear_visible.emplace_back(d.index);
+		}
+	});
+	std::cout << "  linear:       " << linear_ms << " ms (" << linear_visible.size() << " visible)" << std::endl;
+
+	double build_ms = time_ms(1, [&](){
+		scene.rebuild_drawables_bvh();
+	});
+	std::cout << "  bvh build:    " << build_ms << " ms" << std::endl;
+
+	std::vector< uint32_t > candidates, bvh_visible;
+	double bvh_ms = time_ms(iterations, [&](){
+		scene.find_visible_drawables(world_to_clip, &candidates);
+		bvh_visible.clear();
+		for (uint32_t index : candidates) {
+			Scene::Drawable const &d = scene.drawables.at_index(index);
+			if (!d.outside(world_to_clip * glm::mat4(d.transform->make_local_to_world()))) bvh_visible.emplace_back(index);
+		}
+	});
+	std::cout << "  bvh:          " << bvh_ms << " ms (" << candidates.size() << " candidates; " << linear_ms / bvh_ms << "x vs linear)" << std::endl;
+
+	//move 1% of the drawables each frame, so the hierarchy must be refit:
+	uint32_t moving = std::max(1U, count / 100);
+	double refit_ms = time_ms(iterations, [&](){
+		for (uint32_t i = 0; i < moving; ++i) {
+			Scene::Transform *t = transforms[mt() % count];
+			t->set_position(t->position + glm::vec3(unit(mt), unit(mt), 0.0f));
+		}
+		scene.find_visible_drawables(world_to_clip, &candidates);
+	});
+	std::cout << "  bvh, " << moving << " moving: " << refit_ms << " ms (refit + query)" << std::endl;
+
+	bool match = (linear_visible == bvh_visible);
+	if (!match) std::cout << "  ERROR: bvh and linear culling found different visible sets." << std::endl;
+	return (match ? 0 : 1);
+}
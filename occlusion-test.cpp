@@ -0,0 +1,46 @@
+//Headless checks of OcclusionBuffer against known layouts:
+// a wall in front of the camera, and boxes fully behind it, peeking past its edge, and in front of it.
+//
+//Usage: occlusion-test
+// (prints each check; returns nonzero if any fails)
+
+#include "OcclusionBuffer.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <iostream>
+#include <string>
+
+int main() {
+	//camera at the origin looking down -z:
+	glm::mat4 world_to_clip = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+
+	//wall: 10 x 10 units, 10 units away:
+	OcclusionBuffer buffer;
+	buffer.clear();
+	buffer.add_box(world_to_clip, glm::vec3(-5.0f, -5.0f, -10.5f), glm::vec3(5.0f, 5.0f, -10.0f));
+
+	uint32_t failed = 0;
+	auto check = [&](std::string const &name, glm::vec3 const &min, glm::vec3 const &max, bool expected) {
+		bool occluded = buffer.occluded(world_to_clip, min, max);
+		bool ok = (occluded == expected);
+		std::cout << (ok ? "  ok  " : "FAILED") << " " << name << ": " << (occluded ? "occluded" : "not occluded") << std::endl;
+		if (!ok) failed += 1;
+	};
+
+	//box well inside the wall's shadow:
+	check("box behind wall", glm::vec3(-1.0f, -1.0f, -21.0f), glm::vec3(1.0f, 1.0f, -19.0f), true);
+	//box 20 units away, where the wall's edge (x = 5 at 10 units) is at x = 10, so part of [8,12] shows:
+	check("box peeking past wall's edge", glm::vec3(8.0f, -1.0f, -21.0f), glm::vec3(12.0f, 1.0f, -19.0f), false);
+	//box between the camera and the wall:
+	check("box in front of wall", glm::vec3(-1.0f, -1.0f, -6.0f), glm::vec3(1.0f, 1.0f, -4.0f), false);
+	//the wall doesn't hide itself:
+	check("wall itself", glm::vec3(-5.0f, -5.0f, -10.5f), glm::vec3(5.0f, 5.0f, -10.0f), false);
+
+	if (failed) {
+		std::cout << failed << " check(s) failed." << std::endl;
+		return 1;
+	}
+	std::cout << "All checks passed." << std::endl;
+	return 0;
+}
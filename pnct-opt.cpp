@@ -0,0 +1,441 @@
+//Offline optimizer for .pnct mesh files (as read by MeshBuffer; see Mesh.hpp):
+// - welds identical vertices, turning expanded triangle lists into indexed meshes
+// - reorders each mesh's triangles for the post-transform vertex cache ("Tipsify" --
+//   Sander, Nehab, and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw", 2007)
+// - reorders the clusters of triangles that produces so that outward-facing clusters are drawn first (less overdraw)
+// - renumbers vertices in order of first use (so vertex fetches walk forward through memory)
+//Prints each mesh's average cache miss ratio ("ACMR": vertices shaded per triangle, with
+// a simulated FIFO post-transform cache) before, after welding alone, and after reordering.
+//
+//Usage: pnct-opt <in.pnct> <out.pnct>
+// (input may be expanded or already indexed, so running it again is harmless; in and out may be the same file)
+
+#include "read_write_chunk.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//same layout as the "pnct" chunk read by MeshBuffer:
+struct Vertex {
+	glm::vec3 Position;
+	glm::vec3 Normal;
+	glm::u8vec4 Color;
+	glm::vec2 TexCoord;
+};
+static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
+
+//index entries of expanded ("idx0") and indexed ("idx1") files:
+struct IndexEntry {
+	uint32_t name_begin, name_end;
+	uint32_t vertex_begin, vertex_end;
+};
+static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+
+struct IndexedEntry {
+	uint32_t name_begin, name_end;
+	uint32_t vertex_begin, vertex_end;
+	uint32_t index_begin, index_end;
+};
+static_assert(sizeof(IndexedEntry) == 24, "Index entry should be packed");
+
+//cache size Tipsify optimizes for (smaller than most hardware caches, so results hold up on all of them):
+static constexpr uint32_t TipsifyCacheSize = 16;
+//cache sizes that ACMR is reported for:
+static constexpr uint32_t ReportCacheSizes[2] = { 16, 32 };
+
+struct MeshData {
+	uint32_t name_begin = 0, name_end = 0;
+	std::vector< Vertex > vertices;
+	std::vector< uint32_t > indices; //triangle list, indexing vertices
+};
+
+//vertices shaded per triangle, for a FIFO cache of 'cache_size' entries:
+static float acmr(std::vector< uint32_t > const &indices, uint32_t vertex_count, uint32_t cache_size) {
+	if (indices.empty()) return 0.0f;
+	std::vector< uint32_t > entered(vertex_count, 0); //time (miss count) at which each vertex entered the cache
+	uint32_t misses = 0;
+	for (uint32_t v : indices) {
+		//in cache if entered within the last cache_size misses (entered is counted from 1, so 0 means "never"):
+		if (entered[v] == 0 || misses - entered[v] >= cache_size) {
+			misses += 1;
+			entered[v] = misses;
+		}
+	}
+	return float(misses) / float(indices.size() / 3);
+}
+
+//merge bitwise-identical vertices:
+static void weld(MeshData *mesh_) {
+	MeshData &mesh = *mesh_;
+	struct Hash {
+		size_t operator()(Vertex const &v) const {
+			//FNV-1a over the vertex's bytes:
+			uint64_t h = 14695981039346656037ULL;
+			unsigned char const *b = reinterpret_cast< unsigned char const * >(&v);
+			for (size_t i = 0; i < sizeof(Vertex); ++i) {
+				h = (h ^ b[i]) * 1099511628211ULL;
+			}
+			return size_t(h);
+		}
+	};
+	struct Equal {
+		bool operator()(Vertex const &a, Vertex const &b) const {
+			return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+		}
+	};
+	std::unordered_map< Vertex, uint32_t, Hash, Equal > welded;
+	welded.reserve(mesh.vertices.size());
+	std::vector< Vertex > vertices;
+	std::vector< uint32_t > remap(mesh.vertices.size());
+	for (uint32_t v = 0; v < mesh.vertices.size(); ++v) {
+		auto ret = welded.emplace(mesh.vertices[v], uint32_t(vertices.size()));
+		if (ret.second) vertices.emplace_back(mesh.vertices[v]);
+		remap[v] = ret.first->second;
+	}
+	for (uint32_t &i : mesh.indices) {
+		i = remap[i];
+	}
+	mesh.vertices = std::move(vertices);
+}
+
+//reorder triangles for vertex cache locality (Tipsify), then reorder its clusters for overdraw:
+static void reorder_triangles(MeshData *mesh_) {
+	MeshData &mesh = *mesh_;
+	uint32_t vertex_count = uint32_t(mesh.vertices.size());
+	uint32_t triangle_count = uint32_t(mesh.indices.size() / 3);
+	if (triangle_count == 0) return;
+
+	//vertex -> triangle adjacency:
+	std::vector< uint32_t > adjacency_begin(vertex_count + 1, 0);
+	for (uint32_t v : mesh.indices) adjacency_begin[v + 1] += 1;
+	for (uint32_t v = 0; v < vertex_count; ++v) adjacency_begin[v + 1] += adjacency_begin[v];
+	std::vector< uint32_t > adjacency(mesh.indices.size());
+	{
+		std::vector< uint32_t > fill(adjacency_begin.begin(), adjacency_begin.end() - 1);
+		for (uint32_t i = 0; i < mesh.indices.size(); ++i) {
+			adjacency[fill[mesh.indices[i]]++] = i / 3;
+		}
+	}
+
+	std::vector< uint32_t > live(vertex_count); //triangles not yet emitted, per vertex
+	for (uint32_t v = 0; v < vertex_count; ++v) live[v] = adjacency_begin[v + 1] - adjacency_begin[v];
+	std::vector< uint32_t > cache_time(vertex_count, 0); //time at which each vertex entered the cache
+	uint32_t time = TipsifyCacheSize + 1; //(so no vertex starts in the cache)
+	std::vector< uint32_t > dead_ends; //recently used vertices, to continue from when a fan runs out
+	std::vector< bool > emitted(triangle_count, false);
+	uint32_t cursor = 0; //next vertex to try if dead_ends runs out
+
+	std::vector< uint32_t > order; //triangles, in output order
+	order.reserve(triangle_count);
+	std::vector< uint32_t > cluster_begins; //indices in order at which clusters start
+
+	uint32_t fan = 0; //vertex whose triangles are being emitted
+	bool new_cluster = true;
+	std::vector< uint32_t > candidates;
+	while (true) {
+		if (new_cluster) cluster_begins.emplace_back(uint32_t(order.size()));
+
+		//emit all remaining triangles around the fanning vertex:
+		candidates.clear();
+		for (uint32_t a = adjacency_begin[fan]; a < adjacency_begin[fan + 1]; ++a) {
+			uint32_t t = adjacency[a];
+			if (emitted[t]) continue;
+			emitted[t] = true;
+			order.emplace_back(t);
+			for (uint32_t c = 0; c < 3; ++c) {
+				uint32_t v = mesh.indices[3 * t + c];
+				dead_ends.emplace_back(v);
+				candidates.emplace_back(v);
+				live[v] -= 1;
+				if (time - cache_time[v] > TipsifyCacheSize) {
+					cache_time[v] = time;
+					time += 1;
+				}
+			}
+		}
+
+		//next fanning vertex is the candidate that will stay in cache longest while its fan is emitted:
+		uint32_t next = -1U;
+		uint32_t best = 0;
+		for (uint32_t v : candidates) {
+			if (live[v] == 0) continue;
+			uint32_t priority = 0;
+			if (time - cache_time[v] + 2 * live[v] <= TipsifyCacheSize) priority = time - cache_time[v];
+			if (next == -1U || priority > best) {
+				next = v;
+				best = priority;
+			}
+		}
+		new_cluster = false;
+		if (next == -1U) {
+			//dead end -- continue from a recently used vertex, or failing that, the next unfinished one:
+			// (either way, the cache no longer helps much, so this is a good place for a cluster boundary)
+			new_cluster = true;
+			while (!dead_ends.empty() && next == -1U) {
+				uint32_t v = dead_ends.back();
+				dead_ends.pop_back();
+				if (live[v] > 0) next = v;
+			}
+			while (cursor < vertex_count && next == -1U) {
+				if (live[cursor] > 0) next = cursor;
+				cursor += 1;
+			}
+			if (next == -1U) break;
+		}
+		fan = next;
+	}
+	assert(order.size() == triangle_count);
+	cluster_begins.emplace_back(triangle_count);
+
+	//sort clusters so those whose (area-weighted) normals point away from the mesh's center come first:
+	// (they're the ones likely to be in front of other parts of the mesh from wherever they're visible)
+	struct Cluster {
+		uint32_t begin, end;
+		float sort_key;
+	};
+	std::vector< Cluster > clusters;
+	clusters.reserve(cluster_begins.size() - 1);
+	glm::vec3 mesh_center = glm::vec3(0.0f);
+	float mesh_area = 0.0f;
+	std::vector< glm::vec3 > cluster_centers, cluster_normals;
+	for (uint32_t c = 0; c + 1 < cluster_begins.size(); ++c) {
+		glm::vec3 center = glm::vec3(0.0f);
+		glm::vec3 normal = glm::vec3(0.0f);
+		float area = 0.0f; //(twice the area, as are the weights in center)
+		for (uint32_t o = cluster_begins[c]; o < cluster_begins[c + 1]; ++o) {
+			uint32_t t = order[o];
+			glm::vec3 const &a = mesh.vertices[mesh.indices[3 * t + 0]].Position;
+			glm::vec3 const &b = mesh.vertices[mesh.indices[3 * t + 1]].Position;
+			glm::vec3 const &d = mesh.vertices[mesh.indices[3 * t + 2]].Position;
+			glm::vec3 n = glm::cross(b - a, d - a);
+			center += glm::length(n) * (a + b + d) / 3.0f;
+			normal += n;
+			area += glm::length(n);
+		}
+		mesh_center += center;
+		mesh_area += area;
+		cluster_centers.emplace_back(area > 0.0f ? center / area : center);
+		cluster_normals.emplace_back(normal);
+		clusters.emplace_back(Cluster{cluster_begins[c], cluster_begins[c + 1], 0.0f});
+	}
+	if (mesh_area > 0.0f) mesh_center /= mesh_area;
+	for (uint32_t c = 0; c < clusters.size(); ++c) {
+		float length = glm::length(cluster_normals[c]);
+		clusters[c].sort_key = (length > 0.0f ? glm::dot(cluster_centers[c] - mesh_center, cluster_normals[c] / length) : 0.0f);
+	}
+	std::stable_sort(clusters.begin(), clusters.end(), [](Cluster const &a, Cluster const &b) {
+		return a.sort_key > b.sort_key;
+	});
+
+	std::vector< uint32_t > indices;
+	indices.reserve(mesh.indices.size());
+	for (Cluster const &cluster : clusters) {
+		for (uint32_t o = cluster.begin; o < cluster.end; ++o) {
+			uint32_t t = order[o];
+			indices.emplace_back(mesh.indices[3 * t + 0]);
+			indices.emplace_back(mesh.indices[3 * t + 1]);
+			indices.emplace_back(mesh.indices[3 * t + 2]);
+		}
+	}
+	mesh.indices = std::move(indices);
+}
+
+//renumber vertices in order of first use (dropping unused ones):
+static void reorder_vertices(MeshData *mesh_) {
+	MeshData &mesh = *mesh_;
+	std::vector< uint32_t > remap(mesh.vertices.size(), -1U);
+	std::vector< Vertex > vertices;
+	vertices.reserve(mesh.vertices.size());
+	for (uint32_t &i : mesh.indices) {
+		if (remap[i] == -1U) {
+			remap[i] = uint32_t(vertices.size());
+			vertices.emplace_back(mesh.vertices[i]);
+		}
+		i = remap[i];
+	}
+	mesh.vertices = std::move(vertices);
+}
+
+int main(int argc, char **argv) {
+	if (argc != 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " <in.pnct> <out.pnct>\nWelds, reorders, and indexes the meshes in a .pnct file." << std::endl;
+		return 1;
+	}
+	std::string in_filename = argv[1];
+	std::string out_filename = argv[2];
+
+	try {
+		//--- read (the same way as MeshBuffer) ---
+		std::vector< char > strings;
+		std::vector< MeshData > meshes;
+		{
+			std::ifstream file(in_filename, std::ios::binary);
+			if (!file) throw std::runtime_error("Failed to open '" + in_filename + "'.");
+
+			std::vector< Vertex > data;
+			read_chunk(file, "pnct", &data);
+
+			std::vector< uint32_t > indices;
+			bool indexed = false;
+			{
+				char magic[4] = {'\0', '\0', '\0', '\0'};
+				std::streampos at = file.tellg();
+				file.read(magic, 4);
+				file.clear();
+				file.seekg(at);
+
+				if (std::string(magic, 4) == "ix16") {
+					std::vector< uint16_t > indices16;
+					read_chunk(file, "ix16", &indices16);
+					indices.assign(indices16.begin(), indices16.end());
+					indexed = true;
+				} else if (std::string(magic, 4) == "ix32") {
+					read_chunk(file, "ix32", &indices);
+					indexed = true;
+				}
+			}
+
+			read_chunk(file, "str0", &strings);
+
+			auto add_mesh = [&](uint32_t name_begin, uint32_t name_end, uint32_t vertex_begin, uint32_t vertex_end) -> MeshData & {
+				if (!(name_begin <= name_end && name_end <= strings.size())) {
+					throw std::runtime_error("index entry has out-of-range name begin/end");
+				}
+				if (!(vertex_begin <= vertex_end && vertex_end <= data.size())) {
+					throw std::runtime_error("index entry has out-of-range vertex start/count");
+				}
+				meshes.emplace_back();
+				MeshData &mesh = meshes.back();
+				mesh.name_begin = name_begin;
+				mesh.name_end = name_end;
+				mesh.vertices.assign(data.begin() + vertex_begin, data.begin() + vertex_end);
+				return mesh;
+			};
+
+			if (!indexed) {
+				std::vector< IndexEntry > index;
+				read_chunk(file, "idx0", &index);
+				for (auto const &entry : index) {
+					MeshData &mesh = add_mesh(entry.name_begin, entry.name_end, entry.vertex_begin, entry.vertex_end);
+					mesh.indices.resize(mesh.vertices.size());
+					for (uint32_t i = 0; i < mesh.indices.size(); ++i) mesh.indices[i] = i;
+				}
+			} else {
+				std::vector< IndexedEntry > index;
+				read_chunk(file, "idx1", &index);
+				for (auto const &entry : index) {
+					MeshData &mesh = add_mesh(entry.name_begin, entry.name_end, entry.vertex_begin, entry.vertex_end);
+					if (!(entry.index_begin <= entry.index_end && entry.index_end <= indices.size())) {
+						throw std::runtime_error("index entry has out-of-range index start/count");
+					}
+					mesh.indices.assign(indices.begin() + entry.index_begin, indices.begin() + entry.index_end);
+					for (uint32_t i : mesh.indices) {
+						if (i >= mesh.vertices.size()) throw std::runtime_error("index entry has index past the end of its vertices");
+					}
+				}
+			}
+
+			if (file.peek() != EOF) {
+				std::cerr << "WARNING: trailing data in mesh file '" << in_filename << "'" << std::endl;
+			}
+		}
+
+		//--- optimize ---
+		std::cout << std::fixed << std::setprecision(3);
+		std::cout << "ACMR is for FIFO caches of " << ReportCacheSizes[0] << " / " << ReportCacheSizes[1] << " vertices." << std::endl;
+		uint64_t total_triangles = 0;
+		uint64_t total_vertices_before = 0, total_vertices_after = 0;
+		double total_misses_before[2] = {0.0, 0.0}, total_misses_welded[2] = {0.0, 0.0}, total_misses_after[2] = {0.0, 0.0};
+		for (MeshData &mesh : meshes) {
+			std::string name(strings.begin() + mesh.name_begin, strings.begin() + mesh.name_end);
+			if (mesh.indices.size() % 3 != 0) {
+				throw std::runtime_error("Mesh '" + name + "' has " + std::to_string(mesh.indices.size()) + " indices, which isn't a whole number of triangles.");
+			}
+			uint32_t triangles = uint32_t(mesh.indices.size() / 3);
+			uint32_t vertices_before = uint32_t(mesh.vertices.size());
+			float before[2], welded[2], after[2];
+			for (uint32_t c = 0; c < 2; ++c) before[c] = acmr(mesh.indices, vertices_before, ReportCacheSizes[c]);
+
+			weld(&mesh);
+			for (uint32_t c = 0; c < 2; ++c) welded[c] = acmr(mesh.indices, uint32_t(mesh.vertices.size()), ReportCacheSizes[c]);
+
+			reorder_triangles(&mesh);
+			reorder_vertices(&mesh);
+
+			for (uint32_t c = 0; c < 2; ++c) after[c] = acmr(mesh.indices, uint32_t(mesh.vertices.size()), ReportCacheSizes[c]);
+
+			std::cout << "'" << name << "': " << triangles << " triangles, "
+				<< vertices_before << " -> " << mesh.vertices.size() << " vertices, ACMR "
+				<< before[0] << " / " << before[1] << " -> welded " << welded[0] << " / " << welded[1]
+				<< " -> reordered " << after[0] << " / " << after[1] << std::endl;
+
+			total_triangles += triangles;
+			total_vertices_before += vertices_before;
+			total_vertices_after += mesh.vertices.size();
+			for (uint32_t c = 0; c < 2; ++c) {
+				total_misses_before[c] += double(before[c]) * triangles;
+				total_misses_welded[c] += double(welded[c]) * triangles;
+				total_misses_after[c] += double(after[c]) * triangles;
+			}
+		}
+		if (total_triangles > 0) {
+			std::cout << "total: " << total_triangles << " triangles, "
+				<< total_vertices_before << " -> " << total_vertices_after << " vertices, ACMR "
+				<< total_misses_before[0] / total_triangles << " / " << total_misses_before[1] / total_triangles << " -> welded "
+				<< total_misses_welded[0] / total_triangles << " / " << total_misses_welded[1] / total_triangles << " -> reordered "
+				<< total_misses_after[0] / total_triangles << " / " << total_misses_after[1] / total_triangles << std::endl;
+		}
+
+		//--- write (indices are relative to each mesh's first vertex, so they are 16-bit unless some mesh is huge) ---
+		std::vector< Vertex > data;
+		std::vector< uint32_t > indices;
+		std::vector< IndexedEntry > index;
+		bool wide = false;
+		for (MeshData const &mesh : meshes) {
+			if (mesh.vertices.size() > 0x10000) wide = true;
+			IndexedEntry entry;
+			entry.name_begin = mesh.name_begin;
+			entry.name_end = mesh.name_end;
+			entry.vertex_begin = uint32_t(data.size());
+			data.insert(data.end(), mesh.vertices.begin(), mesh.vertices.end());
+			entry.vertex_end = uint32_t(data.size());
+			entry.index_begin = uint32_t(indices.size());
+			indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+			entry.index_end = uint32_t(indices.size());
+			index.emplace_back(entry);
+		}
+
+		std::ofstream file(out_filename, std::ios::binary);
+		if (!file) throw std::runtime_error("Failed to open '" + out_filename + "' for writing.");
+		write_chunk("pnct", data, &file);
+		if (wide) {
+			write_chunk("ix32", indices, &file);
+		} else {
+			std::vector< uint16_t > indices16(indices.begin(), indices.end());
+			write_chunk("ix16", indices16, &file);
+		}
+		write_chunk("str0", strings, &file);
+		write_chunk("idx1", index, &file);
+		if (!file) throw std::runtime_error("Failed to write '" + out_filename + "'.");
+
+		size_t index_bytes = indices.size() * (wide ? 4 : 2);
+		std::cout << "Wrote " << file.tellp() << " bytes [" << data.size() * sizeof(Vertex) << " bytes of vertices + "
+			<< index_bytes << " bytes of " << (wide ? 32 : 16) << "-bit indices, was "
+			<< total_vertices_before * sizeof(Vertex) << " bytes of vertices] to '" << out_filename << "'" << std::endl;
+	} catch (std::exception const &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
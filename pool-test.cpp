@@ -0,0 +1,85 @@
+//Headless checks of Pool handles across erase, clear, copies and assignment:
+// handles to objects that are gone (including objects replaced by assigning another pool) must not validate.
+//
+//Usage: pool-test
+// (prints each check; returns nonzero if any fails)
+
+#include "Pool.hpp"
+
+#include <iostream>
+#include <string>
+
+int main() {
+	typedef Pool< int, 4 > IntPool;
+
+	uint32_t failed = 0;
+	auto check = [&](std::string const &name, bool ok) {
+		std::cout << (ok ? "  ok  " : "FAILED") << " " << name << std::endl;
+		if (!ok) failed += 1;
+	};
+
+	{ //erase and re-use:
+		IntPool pool;
+		IntPool::Handle a = pool.handle(&pool.emplace_back(1));
+		pool.erase(a);
+		IntPool::Handle b = pool.handle(&pool.emplace(2));
+		check("erased handle is dead", pool.get(a) == nullptr);
+		check("re-used slot has a new handle", b.index == a.index && pool.get(b) && *pool.get(b) == 2);
+	}
+
+	{ //copy construction keeps slots and handles:
+		IntPool source;
+		for (int i = 0; i < 10; ++i) source.emplace_back(i);
+		source.erase(&source.at_index(3));
+		IntPool::Handle h = source.handle(&source.at_index(7));
+		IntPool copy(source);
+		check("copy has the same objects", copy.size() == 9 && !copy.occupied(3) && copy.at_index(7) == 7);
+		check("source handle works in a copy-constructed pool", copy.get(h) && *copy.get(h) == 7);
+	}
+
+	//assignment invalidates handles to the destination's old objects:
+	auto check_assign = [&](std::string const &name, bool move) {
+		IntPool dest;
+		for (int i = 0; i < 10; ++i) dest.emplace_back(100 + i);
+		IntPool::Handle old_first = dest.handle(&dest.at_index(0));
+		IntPool::Handle old_last = dest.handle(&dest.at_index(9));
+		//churn slot 0 so its generation is well past the source's:
+		for (int i = 0; i < 5; ++i) {
+			dest.erase(&dest.at_index(0));
+			dest.emplace(100);
+		}
+		IntPool::Handle churned = dest.handle(&dest.at_index(0));
+
+		IntPool source;
+		for (int i = 0; i < 4; ++i) source.emplace_back(i);
+
+		if (move) dest = std::move(source);
+		else dest = source;
+
+		check(name + ": contents", dest.size() == 4 && dest.slots() == 4 && dest.at_index(0) == 0 && dest.at_index(3) == 3);
+		check(name + ": old handles are dead", dest.get(old_first) == nullptr && dest.get(old_last) == nullptr && dest.get(churned) == nullptr);
+		check(name + ": new handles work", dest.get(dest.handle(&dest.at_index(0))) == &dest.at_index(0));
+
+		//refilling the slots the source didn't have mustn't revive handles to the old objects:
+		for (int i = 0; i < 6; ++i) dest.emplace_back(200 + i);
+		check(name + ": refilled slots don't revive old handles", dest.get(old_last) == nullptr);
+		check(name + ": refilled slots have new handles", dest.get(dest.handle(&dest.at_index(9))) == &dest.at_index(9));
+	};
+	check_assign("copy-assign", false);
+	check_assign("move-assign", true);
+
+	{ //clear then refill:
+		IntPool pool;
+		IntPool::Handle h = pool.handle(&pool.emplace_back(1));
+		pool.clear();
+		pool.emplace_back(2);
+		check("handle from before clear() is dead", pool.get(h) == nullptr);
+	}
+
+	if (failed) {
+		std::cout << failed << " check(s) failed." << std::endl;
+		return 1;
+	}
+	std::cout << "All checks passed." << std::endl;
+	return 0;
+}
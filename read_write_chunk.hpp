@@ -4,6 +4,8 @@
 #include <vector>
 #include <stdexcept>
 #include <cassert>
+#include <cstring>
+#include <type_traits>
 
 //helper function that reads an array of structures preceded by a simple header:
 //Expected format:
@@ -40,6 +42,57 @@ void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *
 	}
 }
 
+//The same format, read in place from memory (e.g., a MappedFile) instead of copied out of a stream:
+// elements are not necessarily aligned in memory, so they are copied out one at a time by operator[]
+template< typename T >
+struct ChunkView {
+	char const *data = nullptr;
+	size_t count = 0;
+	size_t size() const { return count; }
+	T operator[](size_t i) const {
+		assert(i < count);
+		T t;
+		std::memcpy(&t, data + i * sizeof(T), sizeof(T));
+		return t;
+	}
+};
+
+//reads the chunk at *at_ (which must be before end), advancing *at_ past it:
+template< typename T >
+ChunkView< T > read_chunk(char const **at_, char const *end, std::string const &magic) {
+	static_assert(std::is_trivially_copyable< T >::value, "chunk elements are copied with memcpy");
+	assert(at_);
+	auto &at = *at_;
+
+	struct ChunkHeader {
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		uint32_t size = 0;
+	};
+	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+
+	ChunkHeader header;
+	if (size_t(end - at) < sizeof(header)) {
+		throw std::runtime_error("Failed to read chunk header");
+	}
+	std::memcpy(&header, at, sizeof(header));
+	at += sizeof(header);
+	if (std::string(header.magic,4) != magic) {
+		throw std::runtime_error("Unexpected magic number in chunk");
+	}
+
+	if (header.size % sizeof(T) != 0) {
+		throw std::runtime_error("Size of chunk not divisible by element size");
+	}
+	if (size_t(end - at) < header.size) {
+		throw std::runtime_error("Failed to read chunk data.");
+	}
+
+	ChunkView< T > view;
+	view.data = at;
+	view.count = header.size / sizeof(T);
+	at += header.size;
+	return view;
+}
 
 //helper function to write a chunk of data in the same format as read_chunk:
 template< typename T >
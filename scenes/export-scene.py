@@ -57,6 +57,8 @@ else:
 # msh0 len < uint uint uint > [hierarchy point + mesh name]
 # cam0 len < uint params > [heirarchy point + camera params]
 # lig0 len < uint params > [hierarchy point + light params]
+# trk0 len < uint char pad[3] uint uint > [(optional) hierarchy point + channel ('p', 'r', or 's') + range of keys]
+# key0 len < float float[4] > [(optional, with trk0) time in seconds + value (position/scale xyz, or rotation xyzw)]
 
 strings_data = b""
 xfh_data = b""
@@ -179,7 +181,12 @@ def write_light(obj):
 		)
 	print("  Energy: " + str(f*obj.data.energy))
 	lamp_data += struct.pack('f', f*obj.data.energy)
-	lamp_data += struct.pack('f', obj.data.distance)
+	#cutoff distance (0 for none); n.b. obj.data.distance is the falloff distance, which isn't a cutoff:
+	cutoff = 0.0
+	if getattr(obj.data, 'use_custom_distance', False):
+		cutoff = obj.data.cutoff_distance
+		print("  Cutoff distance: " + str(cutoff))
+	lamp_data += struct.pack('f', cutoff)
 	if obj.data.type == 'SPOT':
 		fov = obj.data.spot_size/math.pi*180.0
 		print("  Spot size: " + str(fov) + " degrees.")
@@ -213,6 +220,59 @@ def write_objects(from_collection):
 
 write_objects(collection)
 
+#write animation tracks for objects with actions, sampled at every frame of the scene's frame range:
+track_data = b""
+key_data = b""
+
+def write_tracks():
+	global track_data, key_data
+	animated = []
+	for par_obj, ref in obj_to_xfh.items():
+		obj = par_obj[-1]
+		if obj.animation_data and obj.animation_data.action:
+			animated.append((par_obj, ref))
+	if len(animated) == 0: return
+
+	scene = bpy.context.scene
+	fps = scene.render.fps / scene.render.fps_base
+	times = []
+	samples = dict() #par_obj -> list of decomposed local transforms
+	for frame in range(scene.frame_start, scene.frame_end + 1):
+		scene.frame_set(frame)
+		times.append((frame - scene.frame_start) / fps)
+		for par_obj, ref in animated:
+			obj = par_obj[-1]
+			#(local transform computed as in write_xfh)
+			if obj.parent == None:
+				world_to_parent = mathutils.Matrix()
+			else:
+				world_to_parent = obj.parent.matrix_world.copy()
+				world_to_parent.invert()
+			samples.setdefault(par_obj, []).append((world_to_parent @ obj.matrix_world).decompose())
+
+	key_count = 0
+	for par_obj, ref in animated:
+		print("animation: " + par_obj[-1].name)
+		for channel, index in ((b'p', 0), (b'r', 1), (b's', 2)):
+			values = [ sample[index].copy() for sample in samples[par_obj] ]
+			if all(v == values[0] for v in values): continue #(channel doesn't change)
+			if channel == b'r':
+				#keep quaternions on the same side as their predecessors, so they interpolate the short way:
+				for i in range(1, len(values)):
+					if values[i].dot(values[i-1]) < 0.0: values[i].negate()
+			track_data += ref
+			track_data += channel + b'\0\0\0'
+			track_data += struct.pack('II', key_count, key_count + len(values))
+			for time, v in zip(times, values):
+				if channel == b'r':
+					key_data += struct.pack('5f', time, v.x, v.y, v.z, v.w)
+				else:
+					key_data += struct.pack('5f', time, v.x, v.y, v.z, 0.0)
+			key_count += len(values)
+			print("  " + channel.decode('utf8') + ": " + str(len(values)) + " keys")
+
+write_tracks()
+
 #write the strings chunk and scene chunk to an output blob:
 blob = open(outfile, 'wb')
 def write_chunk(magic, data):
@@ -224,7 +284,10 @@ write_chunk(b'str0', strings_data)
 write_chunk(b'xfh0', xfh_data)
 write_chunk(b'msh0', mesh_data)
 write_chunk(b'cam0', camera_data)
-write_chunk(b'lmp0', lamp_data)
+write_chunk(b'lmp1', lamp_data) #(lmp1: lights' distances are cutoffs)
+if len(track_data) > 0:
+	write_chunk(b'trk0', track_data)
+	write_chunk(b'key0', key_data)
 
 print("Wrote " + str(blob.tell()) + " bytes to '" + outfile + "'")
 blob.close()
@@ -120,6 +120,11 @@ int main(int argc, char **argv) {
 				drawable.pipeline.type = mesh.type;
 				drawable.pipeline.start = mesh.start;
 				drawable.pipeline.count = mesh.count;
+				drawable.pipeline.index_type = mesh.index_type;
+				drawable.pipeline.base_vertex = mesh.base_vertex;
+
+				drawable.min = mesh.min;
+				drawable.max = mesh.max;
 
 			});
 		} catch (std::exception &e) {
@@ -0,0 +1,105 @@
+//Headless checks of Scene::Streaming against a blocking Scene::load:
+// a scene streamed in small per-update pieces ends up the same as one loaded all at once,
+// and a file that fails to parse keeps reporting its failure (rather than crashing) on later updates.
+//
+//Usage: streaming-test [scene file]
+// (defaults to the game's hexapod.scene; prints each check; returns nonzero if any fails)
+
+#include "Scene.hpp"
+#include "data_path.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main(int argc, char **argv) {
+	std::string filename = (argc > 1 ? argv[1] : data_path("../dist/hexapod.scene"));
+
+	uint32_t failed = 0;
+	auto check = [&](std::string const &name, bool ok) {
+		std::cout << (ok ? "  ok  " : "FAILED") << " " << name << std::endl;
+		if (!ok) failed += 1;
+	};
+
+	//record mesh callbacks (and make a drawable for each, as a game would):
+	auto recorder = [](std::vector< std::string > *calls) {
+		return [calls](Scene &scene, Scene::Transform *transform, std::string const &mesh_name) {
+			calls->emplace_back(transform->name + ":" + mesh_name);
+			scene.drawables.emplace_back(transform);
+		};
+	};
+
+	Scene loaded;
+	std::vector< std::string > loaded_calls;
+	try {
+		loaded.load(filename, recorder(&loaded_calls));
+	} catch (std::exception &e) {
+		std::cout << "Failed to load '" << filename << "': " << e.what() << std::endl;
+		return 1;
+	}
+
+	//stream with a zero budget, so that every update commits as little as it can:
+	Scene streamed;
+	std::vector< std::string > streamed_calls;
+	Scene::Streaming streaming(filename);
+	uint32_t updates = 0;
+	uint32_t committing_updates = 0; //updates after parsing finished
+	bool done = false;
+	while (!done && updates < 1000000) {
+		bool parsed = (streaming.batch != nullptr);
+		done = streaming.update(&streamed, recorder(&streamed_calls), 0.0f);
+		updates += 1;
+		if (parsed) committing_updates += 1;
+		if (!done && !streaming.batch) std::this_thread::sleep_for(std::chrono::milliseconds(1)); //(still parsing)
+	}
+	check("streaming finishes", done);
+	check("commit is split across updates (" + std::to_string(committing_updates) + " after parsing)", loaded.transforms.size() <= 16 || committing_updates > 1);
+	check("update after finishing is a no-op", streaming.update(&streamed, recorder(&streamed_calls), 0.0f) && streamed_calls.size() == loaded_calls.size());
+
+	//compare against the blocking load:
+	check("same transform count", streamed.transforms.size() == loaded.transforms.size());
+	bool same_transforms = (streamed.transforms.size() == loaded.transforms.size());
+	for (auto s = streamed.transforms.begin(), l = loaded.transforms.begin(); same_transforms && s != streamed.transforms.end(); ++s, ++l) {
+		same_transforms = s->name == l->name
+			&& s->position == l->position && s->rotation == l->rotation && s->scale == l->scale
+			&& (s->parent ? s->parent->name : "") == (l->parent ? l->parent->name : "")
+			&& s->make_local_to_world() == l->make_local_to_world();
+	}
+	check("same transforms (names, values, parents, world matrices)", same_transforms);
+	check("same mesh callbacks, in the same order", streamed_calls == loaded_calls);
+	check("same drawable count", streamed.drawables.size() == loaded.drawables.size());
+	check("same camera and light counts", streamed.cameras.size() == loaded.cameras.size() && streamed.lights.size() == loaded.lights.size());
+	bool same_names = true;
+	for (auto const &t : loaded.transforms) {
+		Scene::Transform *found = streamed.find_transform(t.name);
+		same_names = same_names && found && found->name == t.name;
+	}
+	check("every transform can be found by name", same_names);
+
+	//a file that fails to parse:
+	{
+		Scene scene;
+		Scene::Streaming bad(filename + ".does-not-exist");
+		uint32_t throws = 0;
+		bool finished = false;
+		for (uint32_t i = 0; i < 10000 && throws < 3; ++i) {
+			try {
+				finished = bad.update(&scene, nullptr, 0.0f) || finished;
+			} catch (std::exception &) {
+				throws += 1;
+			}
+			if (!throws) std::this_thread::sleep_for(std::chrono::milliseconds(1)); //(still parsing)
+		}
+		check("parse failure is rethrown by every later update", throws == 3 && !finished);
+		check("failed stream adds nothing to the scene", scene.transforms.size() == 0 && scene.drawables.size() == 0);
+	}
+
+	if (failed) {
+		std::cout << failed << " check(s) failed." << std::endl;
+		return 1;
+	}
+	std::cout << "All checks passed." << std::endl;
+	return 0;
+}
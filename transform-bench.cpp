@@ -0,0 +1,154 @@
+//Microbenchmark comparing ways of computing world matrices for a Scene's transforms:
+// - "transform": Scene::Transform::make_local_to_world (per-node glm, recursive cache)
+// - "scene batched": Scene::Transform::update_local_to_world (SIMD kernel, gathering from the transforms)
+// - "flat glm": TransformHierarchy::update_reference (per-node glm over flat arrays)
+// - "flat batched": TransformHierarchy::update (SIMD kernel over flat arrays)
+// - "N threads": TransformHierarchy::update(ThreadPool &) with N threads
+//
+//Usage: transform-bench [transform count] [iterations]
+// (with no arguments, runs 10k, 100k, and 1M transforms)
+
+#include "Scene.hpp"
+#include "TransformHierarchy.hpp"
+#include "ThreadPool.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <algorithm>
+
+//build a scene of 'count' transforms arranged as many small rigs of varying depth:
+static void make_test_scene(Scene &scene, uint32_t count) {
+	std::mt19937 mt(0x15466);
+	std::uniform_real_distribution< float > unit(-1.0f, 1.0f);
+
+	std::vector< Scene::Transform * > created;
+	created.reserve(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		scene.transforms.emplace_back();
+		Scene::Transform *t = &scene.transforms.back();
+		t->position = glm::vec3(unit(mt), unit(mt), unit(mt)) * 10.0f;
+		t->rotation = glm::normalize(glm::quat(unit(mt), unit(mt), unit(mt), unit(mt)));
+		t->scale = glm::vec3(1.0f) + 0.5f * glm::vec3(unit(mt), unit(mt), unit(mt));
+		//about 1 in 16 transforms is a root; the rest attach to a recent transform:
+		if (i % 16 != 0) {
+			uint32_t back = 1 + uint32_t(mt() % std::min(i, 8U));
+			t->set_parent(created[i - back]);
+		}
+		created.emplace_back(t);
+	}
+}
+
+template< typename F >
+static double time_ms(uint32_t iterations, F const &f) {
+	auto before = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < iterations; ++i) {
+		f();
+	}
+	auto after = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration< double, std::milli >(after - before).count() / iterations;
+}
+
+//check that computed world matrices agree exactly with Scene::Transform:
+static uint32_t count_mismatches(TransformHierarchy const &hierarchy) {
+	uint32_t mismatches = 0;
+	for (uint32_t i = 0; i < hierarchy.size(); ++i) {
+		glm::mat4x3 expected = hierarchy.transforms[i]->make_local_to_world();
+		if (std::memcmp(glm::value_ptr(expected), glm::value_ptr(hierarchy.local_to_world[i]), sizeof(glm::mat4x3)) != 0) {
+			++mismatches;
+		}
+	}
+	return mismatches;
+}
+
+static uint32_t run(uint32_t count, uint32_t iterations) {
+	Scene scene;
+	make_test_scene(scene, count);
+	TransformHierarchy hierarchy(scene);
+
+	std::cout << count << " transforms in " << (hierarchy.level_begins.size() - 1) << " levels, " << iterations << " iterations:" << std::endl;
+
+	double transform_ms = time_ms(iterations, [&](){
+		for (auto &t : scene.transforms) {
+			if (!t.parent) t.mark_dirty();
+		}
+		for (auto const &t : scene.transforms) {
+			t.make_local_to_world();
+		}
+	});
+	std::cout << "  transform:    " << transform_ms << " ms" << std::endl;
+
+	std::vector< glm::mat4x3 > expected;
+	expected.reserve(count);
+	for (auto const &t : scene.transforms) {
+		expected.emplace_back(t.local_to_world);
+	}
+
+	std::vector< Scene::Transform const * > list;
+	double scene_batched_ms = time_ms(iterations, [&](){
+		for (auto &t : scene.transforms) {
+			if (!t.parent) t.mark_dirty();
+		}
+		for (auto const &t : scene.transforms) {
+			list.emplace_back(&t);
+		}
+		Scene::Transform::update_local_to_world(&list);
+	});
+	uint32_t mismatches = 0;
+	{
+		uint32_t i = 0;
+		for (auto const &t : scene.transforms) {
+			if (t.local_to_world_dirty || std::memcmp(glm::value_ptr(expected[i]), glm::value_ptr(t.local_to_world), sizeof(glm::mat4x3)) != 0) {
+				++mismatches;
+			}
+			++i;
+		}
+	}
+	std::cout << "  scene batched: " << scene_batched_ms << " ms (" << transform_ms / scene_batched_ms << "x vs transform)" << std::endl;
+
+	double reference_ms = time_ms(iterations, [&](){
+		hierarchy.update_reference(0, hierarchy.size());
+	});
+	std::cout << "  flat glm:     " << reference_ms << " ms" << std::endl;
+
+	double batched_ms = time_ms(iterations, [&](){
+		hierarchy.update();
+	});
+	mismatches += count_mismatches(hierarchy);
+	std::cout << "  flat batched: " << batched_ms << " ms (" << transform_ms / batched_ms << "x vs transform)" << std::endl;
+
+	//thread scaling (powers of two up to the hardware thread count):
+	uint32_t max_threads = std::max(1U, std::thread::hardware_concurrency());
+	for (uint32_t threads = 1; ; threads = std::min(threads * 2, max_threads)) {
+		ThreadPool pool(threads);
+		std::fill(hierarchy.local_to_world.begin(), hierarchy.local_to_world.end(), glm::mat4x3(0.0f));
+		double threaded_ms = time_ms(iterations, [&](){
+			hierarchy.update(pool);
+		});
+		mismatches += count_mismatches(hierarchy);
+		std::cout << "  " << threads << " thread" << (threads == 1 ? ": " : "s:") << std::string(threads < 10 ? 5 : 4, ' ') << threaded_ms << " ms (" << batched_ms / threaded_ms << "x vs flat batched)" << std::endl;
+		if (threads == max_threads) break;
+	}
+
+	std::cout << "  " << mismatches << " world matrices differ from Scene::Transform." << std::endl;
+	return mismatches;
+}
+
+int main(int argc, char **argv) {
+	std::vector< uint32_t > counts{10000, 100000, 1000000};
+	uint32_t iterations = 20;
+	if (argc > 1) counts = std::vector< uint32_t >{uint32_t(std::stoul(argv[1]))};
+	if (argc > 2) iterations = uint32_t(std::stoul(argv[2]));
+
+	uint32_t mismatches = 0;
+	for (uint32_t count : counts) {
+		mismatches += run(count, iterations);
+	}
+
+	return (mismatches == 0 ? 0 : 1);
+}
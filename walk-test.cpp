@@ -0,0 +1,57 @@
+//Headless checks of Scene::step_fraction (used by PlayMode to keep the walking camera from passing through things):
+// a camera walking into a box stops short of it, and a camera that starts inside a box can still walk out.
+//
+//Usage: walk-test
+// (prints each check; returns nonzero if any fails)
+
+#include "Scene.hpp"
+
+#include <iostream>
+#include <string>
+
+int main() {
+	Scene scene;
+	auto add_box = [&](glm::vec3 const &position, glm::vec3 const &min, glm::vec3 const &max) {
+		Scene::Transform &transform = scene.transforms.emplace_back();
+		transform.position = position;
+		Scene::Drawable &drawable = scene.drawables.emplace_back(&transform);
+		drawable.min = min;
+		drawable.max = max;
+	};
+	//a big box around the origin (e.g., a room's bounds or a leg sweeping over the camera):
+	add_box(glm::vec3(0.0f), glm::vec3(-5.0f), glm::vec3(5.0f));
+	//a wall further along +x:
+	add_box(glm::vec3(20.0f, 0.0f, 0.0f), glm::vec3(-1.0f, -10.0f, -10.0f), glm::vec3(1.0f, 10.0f, 10.0f));
+
+	constexpr float Radius = 1.0f;
+	uint32_t failed = 0;
+	auto check = [&](std::string const &name, bool ok) {
+		std::cout << (ok ? "  ok  " : "FAILED") << " " << name << std::endl;
+		if (!ok) failed += 1;
+	};
+
+	//walk along +x, starting inside the big box, a unit at a time:
+	glm::vec3 position = glm::vec3(0.0f);
+	glm::vec3 step = glm::vec3(1.0f, 0.0f, 0.0f);
+	check("can move while inside a box", scene.step_fraction(position, step, Radius) == 1.0f);
+	for (uint32_t frame = 0; frame < 100; ++frame) {
+		position += scene.step_fraction(position, step, Radius) * step;
+	}
+	check("walked out of the box", position.x > 5.0f);
+	check("stopped short of the wall", std::abs(position.x - (19.0f - Radius)) < 1e-3f);
+
+	//walking back, away from the wall, isn't blocked:
+	check("can walk away from the wall", scene.step_fraction(position, -step, Radius) == 1.0f);
+
+	//raycasts from inside a box still hit it (at distance zero):
+	float distance = -1.0f;
+	uint32_t hit = scene.raycast_drawables(glm::vec3(0.0f), step, &distance);
+	check("raycast from inside a box hits it", hit != -1U && distance == 0.0f);
+
+	if (failed) {
+		std::cout << failed << " check(s) failed." << std::endl;
+		return 1;
+	}
+	std::cout << "All checks passed." << std::endl;
+	return 0;
+}